@@ -1,25 +1,285 @@
 #include <iostream>
 #include <vector>
+#include <array>
 #include <string>
 #include <map>
 #include <cctype>
 #include <cmath>
+#include <algorithm>
 #include <sstream> 
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <random>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <string_view>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+// Fixed-size blocks carved from slabs. Freed blocks go on an intrusive free list and are
+// handed out again before a new slab is taken, so allocation and free are O(1) and a steady
+// workload stops touching the heap. Slabs are only released with the pool. Not thread-safe.
+class FixedPool {
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    
+    size_t blockSize;
+    size_t blocksPerSlab;
+    std::vector<std::unique_ptr<char[]>> slabs;
+    FreeBlock* freeList;
+    // Only the owning thread writes the counters, but statistics may read them from another.
+    // A block freed by a pool other than the one that handed it out counts against the freeing
+    // pool, so a single pool may go negative; sums over all pools are exact.
+    std::atomic<size_t> slabCount;
+    std::atomic<int64_t> inUse;
+    std::atomic<int64_t> peakInUse;
+    std::atomic<uint64_t> allocations;
+    
+    template <typename T>
+    static void add(std::atomic<T>& counter, T delta) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+    
+public:
+    FixedPool(size_t size, size_t slabBlocks)
+        : blockSize(std::max(size, sizeof(FreeBlock))), blocksPerSlab(slabBlocks), freeList(nullptr), slabCount(0),
+          inUse(0), peakInUse(0), allocations(0) {
+        blockSize = (blockSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    }
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+    
+    void* allocate() {
+        if (freeList == nullptr) {
+            slabs.emplace_back(new char[blockSize * blocksPerSlab]);
+            add<size_t>(slabCount, 1);
+            char* slab = slabs.back().get();
+            for (size_t i = blocksPerSlab; i-- > 0;) {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * blockSize);
+                block->next = freeList;
+                freeList = block;
+            }
+        }
+        FreeBlock* block = freeList;
+        freeList = block->next;
+        add<uint64_t>(allocations, 1);
+        add<int64_t>(inUse, 1);
+        if (inUse.load(std::memory_order_relaxed) > peakInUse.load(std::memory_order_relaxed)) {
+            peakInUse.store(inUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return block;
+    }
+    
+    void deallocate(void* pointer) {
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        block->next = freeList;
+        freeList = block;
+        add<int64_t>(inUse, -1);
+    }
+    
+    bool hasFreeBlock() const { return freeList != nullptr; }
+    
+    // Moves the other pool's free blocks here; the slabs they live in stay with the other pool
+    void takeFreeBlocks(FixedPool& other) {
+        while (other.freeList != nullptr) {
+            FreeBlock* block = other.freeList;
+            other.freeList = block->next;
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+    
+    // Takes over the other pool's slabs, free blocks and counters, leaving it empty
+    void absorb(FixedPool& other) {
+        takeFreeBlocks(other);
+        for (std::unique_ptr<char[]>& slab : other.slabs) slabs.push_back(std::move(slab));
+        other.slabs.clear();
+        add<size_t>(slabCount, other.slabCount.exchange(0));
+        add<int64_t>(inUse, other.inUse.exchange(0));
+        add<int64_t>(peakInUse, other.peakInUse.exchange(0));
+        add<uint64_t>(allocations, other.allocations.exchange(0));
+    }
+    
+    size_t getBlockSize() const { return blockSize; }
+    
+    // Totals over pools of the same block size; peak is the sum of the pools' own peaks
+    static std::string summary(const std::vector<const FixedPool*>& pools) {
+        int64_t blocks = 0, peak = 0;
+        size_t reserved = 0;
+        uint64_t total = 0;
+        for (const FixedPool* pool : pools) {
+            blocks += pool->inUse.load(std::memory_order_relaxed);
+            peak += pool->peakInUse.load(std::memory_order_relaxed);
+            reserved += pool->slabCount.load(std::memory_order_relaxed) * pool->blocksPerSlab * pool->blockSize;
+            total += pool->allocations.load(std::memory_order_relaxed);
+        }
+        return "blocks " + std::to_string(blocks) + " peak " + std::to_string(peak) + " block_bytes " +
+               std::to_string(pools.empty() ? 0 : pools[0]->blockSize) + " reserved_bytes " + std::to_string(reserved) +
+               " allocations " + std::to_string(total);
+    }
+    
+    std::string summary() const { return summary({this}); }
+};
+
+// Typed front end; objects are constructed in pool blocks and destroyed back into them
+template <typename T>
+class ObjectPool {
+private:
+    FixedPool pool;
+    
+public:
+    explicit ObjectPool(size_t slabObjects = 1024) : pool(sizeof(T), slabObjects) {}
+    
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* block = pool.allocate();
+        return new (block) T(std::forward<Args>(args)...);
+    }
+    
+    void destroy(T* object) {
+        object->~T();
+        pool.deallocate(object);
+    }
+    
+    const FixedPool& stats() const { return pool; }
+};
+
 class ChessPiece {
 protected:
     char symbol;
     bool isWhite;
+    int8_t typeIndex;
 
 public:
-    ChessPiece(char sym, bool white) : symbol(sym), isWhite(white) {}
+    ChessPiece(char sym, bool white)
+        : symbol(sym), isWhite(white), typeIndex(static_cast<int8_t>(std::string("PNBRQKpnbrqk").find(sym))) {}
     virtual ~ChessPiece() = default;
+    
+private:
+    // Every board allocates its 32 pieces, so they come from pools instead of the general heap.
+    // Each thread has its own pool and takes no lock; a piece freed on another thread than the
+    // one that made it joins the freeing thread's free list. When a thread exits, its slabs and
+    // free blocks go to the shared retired pool, whose free blocks refill threads that run dry.
+    // The registry is never destroyed because pieces can outlive static destructors.
+    struct PoolRegistry {
+        std::mutex mutex;
+        std::vector<const FixedPool*> live;
+        FixedPool retired;
+        
+        explicit PoolRegistry(size_t blockSize) : retired(blockSize, 4096) {}
+    };
+    
+    static PoolRegistry& registry() {
+        static PoolRegistry* shared = new PoolRegistry(sizeof(ChessPiece));
+        return *shared;
+    }
+    
+    static inline thread_local FixedPool* threadPool = nullptr;
+    static inline thread_local bool threadExiting = false;
+    
+    struct PoolOwner {
+        ~PoolOwner() {
+            PoolRegistry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.live.erase(std::find(shared.live.begin(), shared.live.end(), threadPool));
+            shared.retired.absorb(*threadPool);
+            delete threadPool;
+            threadPool = nullptr;
+            threadExiting = true;
+        }
+    };
+    
+    // Null once the thread's pool has been retired; pieces freed that late go to the shared pool
+    static FixedPool* localPool() {
+        if (threadPool == nullptr && !threadExiting) {
+            static thread_local PoolOwner owner;
+            threadPool = new FixedPool(sizeof(ChessPiece), 4096);
+            PoolRegistry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.live.push_back(threadPool);
+        }
+        return threadPool;
+    }
+    
+public:
+    static void* operator new(size_t size) {
+        if (size > sizeof(ChessPiece)) {
+            return ::operator new(size);
+        }
+        FixedPool* pool = localPool();
+        if (pool == nullptr || !pool->hasFreeBlock()) {
+            PoolRegistry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (pool == nullptr) {
+                return shared.retired.allocate();
+            }
+            pool->takeFreeBlocks(shared.retired);
+        }
+        return pool->allocate();
+    }
+    
+    static void operator delete(void* pointer, size_t size) {
+        if (pointer == nullptr) {
+            return;
+        }
+        if (size > sizeof(ChessPiece)) {
+            ::operator delete(pointer);
+            return;
+        }
+        FixedPool* pool = localPool();
+        if (pool == nullptr) {
+            PoolRegistry& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.retired.deallocate(pointer);
+            return;
+        }
+        pool->deallocate(pointer);
+    }
+    
+    // Sums the live thread pools and the retired one, for the server's stats command
+    static std::string poolSummary() {
+        PoolRegistry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        std::vector<const FixedPool*> pools = shared.live;
+        pools.push_back(&shared.retired);
+        return FixedPool::summary(pools) + " threads " + std::to_string(shared.live.size());
+    }
 
     char getSymbol() const { return symbol; }
     bool getIsWhite() const { return isWhite; }
 
+    // Index 0-11 in "PNBRQKpnbrqk" order, used by hashing, evaluation and rule dispatch
+    int getTypeIndex() const { return typeIndex; }
+
     virtual bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const = 0;
     
-    bool isPathClear(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const {
+    static bool isPathClear(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         int dx = (toX > fromX) ? 1 : ((toX < fromX) ? -1 : 0);
         int dy = (toY > fromY) ? 1 : ((toY < fromY) ? -1 : 0);
         
@@ -38,13 +298,28 @@ public:
     }
 };
 
-class Pawn : public ChessPiece {
+// Each piece class states its rule once as a static canMove<White>(). The virtual isValidMove
+// comes from here; hot paths call the rule directly through isValidPieceMove or a per-type
+// instantiation, so it inlines and no vtable is involved.
+template <typename Piece>
+class PieceRules : public ChessPiece {
 public:
-    Pawn(bool white) : ChessPiece(white ? 'P' : 'p', white) {}
+    PieceRules(char sym, bool white) : ChessPiece(sym, white) {}
 
     bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
-        int direction = isWhite ? -1 : 1;
-        int startRow = isWhite ? 6 : 1;
+        return isWhite ? Piece::template canMove<true>(fromX, fromY, toX, toY, board)
+                       : Piece::template canMove<false>(fromX, fromY, toX, toY, board);
+    }
+};
+
+class Pawn : public PieceRules<Pawn> {
+public:
+    Pawn(bool white) : PieceRules(white ? 'P' : 'p', white) {}
+
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
+        int direction = White ? -1 : 1;
+        int startRow = White ? 6 : 1;
         
         if (fromX == toX && toY == fromY + direction && board[toY][toX] == nullptr) {
             return true;
@@ -56,7 +331,7 @@ public:
         }
         
         if ((toX == fromX - 1 || toX == fromX + 1) && toY == fromY + direction && 
-            board[toY][toX] != nullptr && board[toY][toX]->getIsWhite() != isWhite) {
+            board[toY][toX] != nullptr && board[toY][toX]->getIsWhite() != White) {
             return true;
         }
         
@@ -64,11 +339,12 @@ public:
     }
 };
 
-class Rook : public ChessPiece {
+class Rook : public PieceRules<Rook> {
 public:
-    Rook(bool white) : ChessPiece(white ? 'R' : 'r', white) {}
+    Rook(bool white) : PieceRules(white ? 'R' : 'r', white) {}
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         
         if (fromX != toX && fromY != toY) {
             return false;
@@ -78,11 +354,12 @@ public:
     }
 };
 
-class Knight : public ChessPiece {
+class Knight : public PieceRules<Knight> {
 public:
-    Knight(bool white) : ChessPiece(white ? 'N' : 'n', white) {}
+    Knight(bool white) : PieceRules(white ? 'N' : 'n', white) {}
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         
         int dx = std::abs(toX - fromX);
         int dy = std::abs(toY - fromY);
@@ -91,11 +368,12 @@ public:
     }
 };
 
-class Bishop : public ChessPiece {
+class Bishop : public PieceRules<Bishop> {
 public:
-    Bishop(bool white) : ChessPiece(white ? 'B' : 'b', white) {}
+    Bishop(bool white) : PieceRules(white ? 'B' : 'b', white) {}
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         
         if (std::abs(toX - fromX) != std::abs(toY - fromY)) {
             return false;
@@ -105,11 +383,12 @@ public:
     }
 };
 
-class Queen : public ChessPiece {
+class Queen : public PieceRules<Queen> {
 public:
-    Queen(bool white) : ChessPiece(white ? 'Q' : 'q', white) {}
+    Queen(bool white) : PieceRules(white ? 'Q' : 'q', white) {}
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         
         bool isDiagonal = std::abs(toX - fromX) == std::abs(toY - fromY);
         bool isStraight = fromX == toX || fromY == toY;
@@ -122,11 +401,12 @@ public:
     }
 };
 
-class King : public ChessPiece {
+class King : public PieceRules<King> {
 public:
-    King(bool white) : ChessPiece(white ? 'K' : 'k', white) {}
+    King(bool white) : PieceRules(white ? 'K' : 'k', white) {}
 
-    bool isValidMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) const override {
+    template <bool White>
+    static bool canMove(int fromX, int fromY, int toX, int toY, const std::vector<std::vector<ChessPiece*>>& board) {
         
         int dx = std::abs(toX - fromX);
         int dy = std::abs(toY - fromY);
@@ -135,31 +415,351 @@ public:
     }
 };
 
+// The rule of the piece with the given type index, dispatched without a virtual call
+inline bool isValidPieceMove(int typeIndex, int fromX, int fromY, int toX, int toY,
+                             const std::vector<std::vector<ChessPiece*>>& board) {
+    switch (typeIndex) {
+        case 0: return Pawn::canMove<true>(fromX, fromY, toX, toY, board);
+        case 1: return Knight::canMove<true>(fromX, fromY, toX, toY, board);
+        case 2: return Bishop::canMove<true>(fromX, fromY, toX, toY, board);
+        case 3: return Rook::canMove<true>(fromX, fromY, toX, toY, board);
+        case 4: return Queen::canMove<true>(fromX, fromY, toX, toY, board);
+        case 5: return King::canMove<true>(fromX, fromY, toX, toY, board);
+        case 6: return Pawn::canMove<false>(fromX, fromY, toX, toY, board);
+        case 7: return Knight::canMove<false>(fromX, fromY, toX, toY, board);
+        case 8: return Bishop::canMove<false>(fromX, fromY, toX, toY, board);
+        case 9: return Rook::canMove<false>(fromX, fromY, toX, toY, board);
+        case 10: return Queen::canMove<false>(fromX, fromY, toX, toY, board);
+        case 11: return King::canMove<false>(fromX, fromY, toX, toY, board);
+    }
+    return false;
+}
+
+struct Move {
+    int fromX;
+    int fromY;
+    int toX;
+    int toY;
+
+    bool operator==(const Move& other) const {
+        return fromX == other.fromX && fromY == other.fromY && toX == other.toX && toY == other.toY;
+    }
+    bool operator!=(const Move& other) const { return !(*this == other); }
+
+    // Coordinate notation as used by UCI, e.g. "e2e4"
+    std::string toString() const {
+        std::string text(4, ' ');
+        text[0] = static_cast<char>('a' + fromX);
+        text[1] = static_cast<char>('8' - fromY);
+        text[2] = static_cast<char>('a' + toX);
+        text[3] = static_cast<char>('8' - toY);
+        return text;
+    }
+
+    // 12-bit from/to square encoding used by hash table entries
+    uint16_t pack() const {
+        return static_cast<uint16_t>(((fromY * 8 + fromX) << 6) | (toY * 8 + toX));
+    }
+
+    static Move unpack(uint16_t packed) {
+        int from = packed >> 6;
+        int to = packed & 63;
+        return Move{from & 7, from >> 3, to & 7, to >> 3};
+    }
+
+    // Parses "e2e4" (a trailing promotion letter is ignored); returns false on malformed input
+    static bool parse(std::string_view text, Move& move) {
+        if (text.size() < 4 || text.size() > 5) {
+            return false;
+        }
+        move.fromX = std::tolower(text[0]) - 'a';
+        move.fromY = '8' - text[1];
+        move.toX = std::tolower(text[2]) - 'a';
+        move.toY = '8' - text[3];
+        return move.fromX >= 0 && move.fromX < 8 && move.fromY >= 0 && move.fromY < 8 &&
+               move.toX >= 0 && move.toX < 8 && move.toY >= 0 && move.toY < 8;
+    }
+};
+
+ChessPiece* createPiece(char symbol) {
+    bool white = std::isupper(static_cast<unsigned char>(symbol)) != 0;
+    switch (std::tolower(static_cast<unsigned char>(symbol))) {
+        case 'p': return new Pawn(white);
+        case 'r': return new Rook(white);
+        case 'n': return new Knight(white);
+        case 'b': return new Bishop(white);
+        case 'q': return new Queen(white);
+        case 'k': return new King(white);
+        default: return nullptr;
+    }
+}
+
+const std::string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w - - 0 1";
+
+class Zobrist {
+private:
+    uint64_t pieceKeys[12][8][8];
+    uint64_t sideKey;
+
+    // Fixed seed so hashes are identical across runs and machines
+    Zobrist() {
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        for (int p = 0; p < 12; ++p) {
+            for (int y = 0; y < 8; ++y) {
+                for (int x = 0; x < 8; ++x) {
+                    pieceKeys[p][y][x] = next(seed);
+                }
+            }
+        }
+        sideKey = next(seed);
+    }
+
+    static uint64_t next(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    static const Zobrist& instance() {
+        static const Zobrist keys;
+        return keys;
+    }
+
+    uint64_t piece(int typeIndex, int x, int y) const { return pieceKeys[typeIndex][y][x]; }
+    uint64_t side() const { return sideKey; }
+};
+
+class EvalCache {
+private:
+    struct Entry {
+        uint64_t key;
+        int score;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t mask;
+    uint64_t hits;
+    uint64_t misses;
+
+public:
+    // Not thread-safe on purpose: each search thread owns its own cache
+    explicit EvalCache(size_t sizeKb = 256) : mask(0), hits(0), misses(0) {
+        resize(sizeKb);
+    }
+
+    void resize(size_t sizeKb) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= sizeKb * 1024) {
+            count *= 2;
+        }
+        entries.assign(count, Entry{0, 0});
+        mask = count - 1;
+        hits = misses = 0;
+    }
+
+    void clear() {
+        std::fill(entries.begin(), entries.end(), Entry{0, 0});
+        hits = misses = 0;
+    }
+
+    bool probe(uint64_t key, int& score) {
+        const Entry& entry = entries[key & mask];
+        if (entry.key == key) {
+            score = entry.score;
+            ++hits;
+            return true;
+        }
+        ++misses;
+        return false;
+    }
+
+    void store(uint64_t key, int score) {
+        entries[key & mask] = Entry{key, score};
+    }
+
+    size_t size() const { return entries.size(); }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+};
+
+class TranspositionTable {
+public:
+    enum Bound : uint8_t { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+    struct Entry {
+        uint64_t key;
+        uint16_t move;
+        int16_t score;
+        int8_t depth;
+        uint8_t bound;
+    };
+
+private:
+    std::vector<Entry> entries;
+    uint64_t mask;
+
+public:
+    // Owned by the engine rather than a search so it survives between moves, ponderhit and MultiPV lines
+    explicit TranspositionTable(size_t sizeMb = 16) : mask(0) {
+        resize(sizeMb);
+    }
+
+    void resize(size_t sizeMb) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= sizeMb * 1024 * 1024) {
+            count *= 2;
+        }
+        entries.assign(count, Entry{0, 0, 0, 0, BOUND_NONE});
+        mask = count - 1;
+    }
+
+    void clear() {
+        std::fill(entries.begin(), entries.end(), Entry{0, 0, 0, 0, BOUND_NONE});
+    }
+
+    const Entry* probe(uint64_t key) const {
+        const Entry& entry = entries[key & mask];
+        return entry.bound != BOUND_NONE && entry.key == key ? &entry : nullptr;
+    }
+
+    // True when the slot for key holds another position; only the search statistics ask
+    bool collides(uint64_t key) const {
+        const Entry& entry = entries[key & mask];
+        return entry.bound != BOUND_NONE && entry.key != key;
+    }
+
+    // Keeps a deeper result for the same position unless the new one is exact
+    void store(uint64_t key, const Move& move, int score, int depth, Bound bound) {
+        Entry& entry = entries[key & mask];
+        if (entry.key == key && entry.depth > depth && bound != BOUND_EXACT) {
+            return;
+        }
+        entry = Entry{key, move.pack(), static_cast<int16_t>(score), static_cast<int8_t>(depth),
+                      static_cast<uint8_t>(bound)};
+    }
+};
+
+enum class RenderStyle { Text, Unicode };
+
+// Appends into a caller-provided buffer without allocating; output past the end is dropped
+// and remembered in overflow
+struct BufferWriter {
+    char* out;
+    size_t capacity;
+    size_t length = 0;
+    bool overflow = false;
+    
+    BufferWriter(char* buffer, size_t size) : out(buffer), capacity(size) {}
+    
+    void put(const char* text, size_t size) {
+        if (length + size > capacity) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(out + length, text, size);
+        length += size;
+    }
+    
+    void put(const char* text) { put(text, std::strlen(text)); }
+    void put(char c) { put(&c, 1); }
+};
+
 class ChessBoard {
 private:
     std::vector<std::vector<ChessPiece*>> board;
+    // Flat copy of board, one byte per square y * 8 + x: 0 for empty, otherwise 1 + index in
+    // "PNBRQKpnbrqk". Every change to board goes through here too.
+    std::array<uint8_t, 64> mailbox;
     bool whiteToMove;
-    std::map<std::string, std::pair<int, int>> algebraicToCoords;
-    std::map<std::pair<int, int>, std::string> coordsToAlgebraic;
+    uint64_t hash;
 
-    void setupAlgebraicNotation() {
-        for (int i = 0; i < 8; ++i) {
-            for (int j = 0; j < 8; ++j) {
-                std::string notation = std::string(1, 'a' + j) + std::string(1, '8' - i);
-                algebraicToCoords[notation] = {j, i};
-                coordsToAlgebraic[std::make_pair(j, i)] = notation;
+    // The notation tables are the same for every board, so they are built once and shared
+    // rather than allocated with each board
+    struct AlgebraicNotation {
+        std::map<std::string, std::pair<int, int>> algebraicToCoords;
+        std::map<std::pair<int, int>, std::string> coordsToAlgebraic;
+
+        AlgebraicNotation() {
+            for (int i = 0; i < 8; ++i) {
+                for (int j = 0; j < 8; ++j) {
+                    std::string notation = std::string(1, 'a' + j) + std::string(1, '8' - i);
+                    algebraicToCoords[notation] = {j, i};
+                    coordsToAlgebraic[std::make_pair(j, i)] = notation;
+                }
             }
         }
+    };
+
+    static const AlgebraicNotation& notation() {
+        static const AlgebraicNotation tables;
+        return tables;
     }
 
     bool isValidCoordinate(int x, int y) const {
         return x >= 0 && x < 8 && y >= 0 && y < 8;
     }
 
+    // One instantiation per piece type and colour, so the rule inlines into the target loop
+    template <typename Piece, bool White>
+    void addPieceMoves(int fromX, int fromY, std::vector<Move>& moves, bool capturesOnly) const {
+        for (int toY = 0; toY < 8; ++toY) {
+            for (int toX = 0; toX < 8; ++toX) {
+                const ChessPiece* target = board[toY][toX];
+                if (target != nullptr && target->getIsWhite() == White) {
+                    continue;
+                }
+                if (capturesOnly && target == nullptr) {
+                    continue;
+                }
+                if (Piece::template canMove<White>(fromX, fromY, toX, toY, board)) {
+                    moves.push_back(Move{fromX, fromY, toX, toY});
+                }
+            }
+        }
+    }
+
+    void clearPieces() {
+        for (auto& row : board) {
+            for (auto& piece : row) {
+                delete piece;
+                piece = nullptr; 
+            }
+        }
+        mailbox.fill(0);
+    }
+
+    void syncMailbox() {
+        for (int square = 0; square < 64; ++square) {
+            const ChessPiece* piece = board[square >> 3][square & 7];
+            mailbox[square] = piece == nullptr ? 0 : static_cast<uint8_t>(1 + piece->getTypeIndex());
+        }
+    }
+
+    void copyPieces(const ChessBoard& other) {
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                board[y][x] = other.board[y][x] ? createPiece(other.board[y][x]->getSymbol()) : nullptr;
+            }
+        }
+        mailbox = other.mailbox;
+    }
+
+    uint64_t computeHash() const {
+        const Zobrist& keys = Zobrist::instance();
+        uint64_t h = whiteToMove ? 0 : keys.side();
+        for (int square = 0; square < 64; ++square) {
+            if (mailbox[square] != 0) {
+                h ^= keys.piece(mailbox[square] - 1, square & 7, square >> 3);
+            }
+        }
+        return h;
+    }
+
 public:
     ChessBoard() : whiteToMove(true) {
         board.resize(8, std::vector<ChessPiece*>(8, nullptr));
-        setupAlgebraicNotation();
         
         for (int i = 0; i < 8; ++i) {
             board[1][i] = new Pawn(false); 
@@ -186,53 +786,177 @@ public:
         
         board[0][4] = new King(false);
         board[7][4] = new King(true);
+
+        syncMailbox();
+        hash = computeHash();
+    }
+    
+    ChessBoard(const ChessBoard& other)
+        : board(8, std::vector<ChessPiece*>(8, nullptr)),
+          whiteToMove(other.whiteToMove),
+          hash(other.hash) {
+        copyPieces(other);
+    }
+    
+    ChessBoard& operator=(const ChessBoard& other) {
+        if (this != &other) {
+            clearPieces();
+            copyPieces(other);
+            whiteToMove = other.whiteToMove;
+            hash = other.hash;
+        }
+        return *this;
     }
     
     ~ChessBoard() {
-        for (auto& row : board) {
-            for (auto& piece : row) {
-                delete piece;
-                piece = nullptr; 
+        clearPieces();
+    }
+    
+    // Castling and en passant are not tracked, so those fields are always "-"
+    std::string toFen() const {
+        std::string fen;
+        for (int y = 0; y < 8; ++y) {
+            int empty = 0;
+            for (int x = 0; x < 8; ++x) {
+                if (board[y][x] == nullptr) {
+                    ++empty;
+                    continue;
+                }
+                if (empty > 0) fen += static_cast<char>('0' + empty);
+                empty = 0;
+                fen += board[y][x]->getSymbol();
+            }
+            if (empty > 0) fen += static_cast<char>('0' + empty);
+            if (y < 7) fen += '/';
+        }
+        fen += whiteToMove ? " w - - 0 1" : " b - - 0 1";
+        return fen;
+    }
+    
+    // Loads piece placement and side to move; castling and en passant fields are accepted but unused
+    bool loadFen(const std::string& fen) {
+        char squares[8][8] = {};
+        std::istringstream iss(fen);
+        std::string placement, side;
+        if (!(iss >> placement)) {
+            return false;
+        }
+        if (!(iss >> side)) {
+            side = "w";
+        }
+        if (side != "w" && side != "b") {
+            return false;
+        }
+        
+        int x = 0, y = 0;
+        for (char c : placement) {
+            if (c == '/') {
+                if (x != 8) return false;
+                x = 0;
+                ++y;
+            } else if (c >= '1' && c <= '8') {
+                x += c - '0';
+            } else {
+                if (y > 7 || x > 7 || std::string("PNBRQKpnbrqk").find(c) == std::string::npos) return false;
+                squares[y][x++] = c;
+            }
+            if (x > 8) return false;
+        }
+        if (y != 7 || x != 8) {
+            return false;
+        }
+        
+        clearPieces();
+        for (y = 0; y < 8; ++y) {
+            for (x = 0; x < 8; ++x) {
+                board[y][x] = createPiece(squares[y][x]);
+            }
+        }
+        syncMailbox();
+        whiteToMove = side == "w";
+        hash = computeHash();
+        return true;
+    }
+    
+    // One byte per square, y * 8 + x: 0 for empty, otherwise 1 + index in "PNBRQKpnbrqk"
+    void loadSquares(const uint8_t* squares, bool whiteSide) {
+        static const char symbols[] = " PNBRQKpnbrqk";
+        clearPieces();
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                uint8_t code = squares[y * 8 + x];
+                board[y][x] = code >= 1 && code <= 12 ? createPiece(symbols[code]) : nullptr;
             }
         }
+        syncMailbox();
+        whiteToMove = whiteSide;
+        hash = computeHash();
     }
     
-    void display() const {
-        std::cout << "\n   a b c d e f g h\n";
-        std::cout << "  +-----------------+\n";
+    // Enough for either style: the Unicode one spends about 30 bytes per square on escapes
+    static const size_t RENDER_BUFFER_SIZE = 4096;
+    
+    // Renders into buffer and returns the length, or 0 if it does not fit. Text is what
+    // display() prints; Unicode uses chess glyphs on ANSI-coloured squares.
+    size_t render(char* buffer, size_t capacity, RenderStyle style = RenderStyle::Text) const {
+        static const char* const glyphs[6] = {"\u265F", "\u265E", "\u265D", "\u265C", "\u265B", "\u265A"};
+        BufferWriter out(buffer, capacity);
+        if (style == RenderStyle::Text) {
+            out.put("\n   a b c d e f g h\n  +-----------------+\n");
+        } else {
+            out.put("\n   a  b  c  d  e  f  g  h\n");
+        }
         
         for (int i = 0; i < 8; ++i) {
-            std::cout << 8 - i << " |";
-            
+            out.put(static_cast<char>('8' - i));
+            out.put(style == RenderStyle::Text ? " |" : " ");
             for (int j = 0; j < 8; ++j) {
-                if (board[i][j] == nullptr) {
-                    std::cout << ((i + j) % 2 == 0 ? "." : " ");
+                const ChessPiece* piece = board[i][j];
+                if (style == RenderStyle::Text) {
+                    out.put(piece != nullptr ? piece->getSymbol() : ((i + j) % 2 == 0 ? '.' : ' '));
+                    out.put(' ');
+                    continue;
+                }
+                out.put((i + j) % 2 == 0 ? "\x1b[48;5;180m" : "\x1b[48;5;94m");
+                if (piece == nullptr) {
+                    out.put("   ");
                 } else {
-                    std::cout << board[i][j]->getSymbol();
+                    out.put(piece->getIsWhite() ? "\x1b[97m " : "\x1b[30m ");
+                    out.put(glyphs[piece->getTypeIndex() % 6]);
+                    out.put(' ');
                 }
-                std::cout << " ";
             }
-            
-            std::cout << "| " << 8 - i << "\n";
+            out.put(style == RenderStyle::Text ? "| " : "\x1b[0m ");
+            out.put(static_cast<char>('8' - i));
+            out.put('\n');
         }
         
-        std::cout << "  +-----------------+\n";
-        std::cout << "   a b c d e f g h\n\n";
-        
-        std::cout << (whiteToMove ? "White" : "Black") << " to move\n";
+        if (style == RenderStyle::Text) {
+            out.put("  +-----------------+\n   a b c d e f g h\n\n");
+        } else {
+            out.put("   a  b  c  d  e  f  g  h\n\n");
+        }
+        out.put(whiteToMove ? "White to move\n" : "Black to move\n");
+        return out.overflow ? 0 : out.length;
+    }
+    
+    void display(RenderStyle style = RenderStyle::Text) const {
+        char buffer[RENDER_BUFFER_SIZE];
+        std::cout.write(buffer, static_cast<std::streamsize>(render(buffer, sizeof(buffer), style)));
     }
     
     bool makeMove(const std::string& from, const std::string& to) {
+        const std::map<std::string, std::pair<int, int>>& algebraicToCoords = notation().algebraicToCoords;
         if (algebraicToCoords.find(from) == algebraicToCoords.end() || 
             algebraicToCoords.find(to) == algebraicToCoords.end()) {
             std::cout << "Invalid notation. Please use algebraic notation (e.g., e2 to e4).\n";
             return false;
         }
         
-        int fromX = algebraicToCoords[from].first;
-        int fromY = algebraicToCoords[from].second;
-        int toX = algebraicToCoords[to].first;
-        int toY = algebraicToCoords[to].second;
+        int fromX = algebraicToCoords.at(from).first;
+        int fromY = algebraicToCoords.at(from).second;
+        int toX = algebraicToCoords.at(to).first;
+        int toY = algebraicToCoords.at(to).second;
         
         // Validate coordinates
         if (!isValidCoordinate(fromX, fromY) || !isValidCoordinate(toX, toY)) {
@@ -259,18 +983,13 @@ public:
         }
         
         // Check if the move is valid for the piece
-        if (!board[fromY][fromX]->isValidMove(fromX, fromY, toX, toY, board)) {
+        if (!isValidPieceMove(board[fromY][fromX]->getTypeIndex(), fromX, fromY, toX, toY, board)) {
             std::cout << "Invalid move for " << board[fromY][fromX]->getSymbol() << ".\n";
             return false;
         }
         
-        // Perform the move
-        delete board[toY][toX]; // Delete the captured piece (if any)
-        board[toY][toX] = board[fromY][fromX];
-        board[fromY][fromX] = nullptr;
-        
-        // Switch turns
-        whiteToMove = !whiteToMove;
+        // Perform the move and delete the captured piece (if any)
+        delete doMove(Move{fromX, fromY, toX, toY});
         
         return true;
     }
@@ -280,37 +999,4845 @@ public:
         bool whiteKingExists = false;
         bool blackKingExists = false;
         
-        for (const auto& row : board) {
-            for (const auto& piece : row) {
-                if (piece != nullptr) {
-                    if (piece->getSymbol() == 'K') whiteKingExists = true;
-                    if (piece->getSymbol() == 'k') blackKingExists = true;
-                }
-            }
+        for (uint8_t code : mailbox) {
+            if (code == 1 + 5) whiteKingExists = true;
+            if (code == 1 + 11) blackKingExists = true;
         }
         
         return !whiteKingExists || !blackKingExists;
     }
-};
 
-int main() {
-    std::cout << "========== C++ Chess Game ==========\n";
-    std::cout << "Enter moves in algebraic notation (e.g., e2 e4)\n";
-    std::cout << "Enter 'quit' to exit\n";
+    uint64_t getHash() const { return hash; }
+    bool isWhiteToMove() const { return whiteToMove; }
+    const ChessPiece* getPiece(int x, int y) const { return board[y][x]; }
+    // Mailbox code of square y * 8 + x: 0 for empty, otherwise 1 + index in "PNBRQKpnbrqk"
+    uint8_t pieceAt(int square) const { return mailbox[square]; }
     
-    ChessBoard board;
-    std::string input, from, to;
+    // Same rules as makeMove, without the diagnostics
+    bool isLegalMove(const Move& move) const {
+        if (!isValidCoordinate(move.fromX, move.fromY) || !isValidCoordinate(move.toX, move.toY)) {
+            return false;
+        }
+        const ChessPiece* piece = board[move.fromY][move.fromX];
+        if (piece == nullptr || piece->getIsWhite() != whiteToMove) {
+            return false;
+        }
+        const ChessPiece* target = board[move.toY][move.toX];
+        if (target != nullptr && target->getIsWhite() == whiteToMove) {
+            return false;
+        }
+        return isValidPieceMove(piece->getTypeIndex(), move.fromX, move.fromY, move.toX, move.toY, board);
+    }
     
-    while (!board.isGameOver()) {
-        board.display();
+    void generateMoves(std::vector<Move>& moves, bool capturesOnly = false) const {
+        moves.clear();
+        for (int fromY = 0; fromY < 8; ++fromY) {
+            for (int fromX = 0; fromX < 8; ++fromX) {
+                const ChessPiece* piece = board[fromY][fromX];
+                if (piece == nullptr || piece->getIsWhite() != whiteToMove) {
+                    continue;
+                }
+                switch (piece->getTypeIndex()) {
+                    case 0: addPieceMoves<Pawn, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 1: addPieceMoves<Knight, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 2: addPieceMoves<Bishop, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 3: addPieceMoves<Rook, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 4: addPieceMoves<Queen, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 5: addPieceMoves<King, true>(fromX, fromY, moves, capturesOnly); break;
+                    case 6: addPieceMoves<Pawn, false>(fromX, fromY, moves, capturesOnly); break;
+                    case 7: addPieceMoves<Knight, false>(fromX, fromY, moves, capturesOnly); break;
+                    case 8: addPieceMoves<Bishop, false>(fromX, fromY, moves, capturesOnly); break;
+                    case 9: addPieceMoves<Rook, false>(fromX, fromY, moves, capturesOnly); break;
+                    case 10: addPieceMoves<Queen, false>(fromX, fromY, moves, capturesOnly); break;
+                    case 11: addPieceMoves<King, false>(fromX, fromY, moves, capturesOnly); break;
+                }
+            }
+        }
+    }
+    
+    // Moves without validation; the captured piece is handed to the caller, who must
+    // either pass it back to undoMove or delete it
+    ChessPiece* doMove(const Move& move) {
+        const Zobrist& keys = Zobrist::instance();
+        ChessPiece* moving = board[move.fromY][move.fromX];
+        ChessPiece* captured = board[move.toY][move.toX];
         
-        std::cout << "Enter move: ";
-        std::getline(std::cin, input);
+        if (captured != nullptr) {
+            hash ^= keys.piece(captured->getTypeIndex(), move.toX, move.toY);
+        }
+        hash ^= keys.piece(moving->getTypeIndex(), move.fromX, move.fromY);
+        hash ^= keys.piece(moving->getTypeIndex(), move.toX, move.toY);
+        hash ^= keys.side();
+        
+        board[move.toY][move.toX] = moving;
+        board[move.fromY][move.fromX] = nullptr;
+        mailbox[move.toY * 8 + move.toX] = mailbox[move.fromY * 8 + move.fromX];
+        mailbox[move.fromY * 8 + move.fromX] = 0;
+        whiteToMove = !whiteToMove;
+        return captured;
+    }
+    
+    void undoMove(const Move& move, ChessPiece* captured) {
+        const Zobrist& keys = Zobrist::instance();
+        ChessPiece* moving = board[move.toY][move.toX];
+        
+        hash ^= keys.side();
+        hash ^= keys.piece(moving->getTypeIndex(), move.toX, move.toY);
+        hash ^= keys.piece(moving->getTypeIndex(), move.fromX, move.fromY);
+        if (captured != nullptr) {
+            hash ^= keys.piece(captured->getTypeIndex(), move.toX, move.toY);
+        }
+        
+        board[move.fromY][move.fromX] = moving;
+        board[move.toY][move.toX] = captured;
+        mailbox[move.fromY * 8 + move.fromX] = mailbox[move.toY * 8 + move.toX];
+        mailbox[move.toY * 8 + move.toX] = captured == nullptr ? 0 : static_cast<uint8_t>(1 + captured->getTypeIndex());
+        whiteToMove = !whiteToMove;
+    }
+    
+    bool isSquareAttacked(int x, int y, bool byWhite) const {
+        for (int fromY = 0; fromY < 8; ++fromY) {
+            for (int fromX = 0; fromX < 8; ++fromX) {
+                const ChessPiece* piece = board[fromY][fromX];
+                if (piece != nullptr && piece->getIsWhite() == byWhite && (fromX != x || fromY != y) &&
+                    isValidPieceMove(piece->getTypeIndex(), fromX, fromY, x, y, board)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    
+    // Validated move that quietly fails instead of printing like makeMove
+    bool applyMove(const Move& move) {
+        if (!isLegalMove(move)) {
+            return false;
+        }
+        delete doMove(move);
+        return true;
+    }
+
+    // Material plus a small centralization bonus, from the side to move's point of view
+    int evaluate() const {
+        static const int pieceValues[6] = {100, 320, 330, 500, 900, 0};
+        static const int centerBonus[6] = {4, 6, 4, 1, 2, 0};
+        int score = 0;
+        
+        for (int square = 0; square < 64; ++square) {
+            int code = mailbox[square];
+            if (code == 0) {
+                continue;
+            }
+            int x = square & 7, y = square >> 3;
+            int type = (code - 1) % 6;
+            int centrality = 6 - (std::abs(2 * x - 7) + std::abs(2 * y - 7)) / 2;
+            int value = pieceValues[type] + centerBonus[type] * centrality;
+            score += code <= 6 ? value : -value;
+        }
+        
+        return whiteToMove ? score : -score;
+    }
+
+    int evaluate(EvalCache& cache) const {
+        int score;
+        if (cache.probe(hash, score)) {
+            return score;
+        }
+        score = evaluate();
+        cache.store(hash, score);
+        return score;
+    }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* data;
+    size_t length;
+    
+public:
+    // Scans want read-ahead; lookup structures touch a few scattered pages per probe and
+    // would only have read-ahead pull in pages nobody asked for
+    enum class Access { Sequential, Random };
+    
+    MappedFile() : data(nullptr), length(0) {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const std::string& path, Access access = Access::Sequential) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            data = static_cast<const char*>(mapped);
+            madvise(mapped, length, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+        ::close(fd);
+        return true;
+    }
+    
+    void close() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), length);
+        }
+        data = nullptr;
+        length = 0;
+    }
+    
+    const char* begin() const { return data; }
+    const char* end() const { return data + length; }
+    size_t size() const { return length; }
+};
+
+bool isKing(const ChessPiece* piece) {
+    return piece != nullptr && piece->getTypeIndex() % 6 == 5;
+}
+
+// Endgame table for one material signature such as "KRvKP" (white pieces, 'v', black
+// pieces), under ChessBoard's rules: the game ends when a king is captured and pawns never
+// promote. One byte per position: 0 draw, 1..127 the side to move captures the king in
+// that many plies, 128 + n the side to move loses in n plies.
+//
+// Index: squares of the pieces in signature order, 6 bits each, plus one bit for black to move.
+// File: "COTB" u8 piece count, 3 reserved bytes, 8-byte signature, then the value bytes.
+class Tablebase {
+private:
+    std::string signature;
+    std::string pieces;
+    MappedFile file;
+    std::vector<uint8_t> owned;
+    const uint8_t* values;
+    
+public:
+    static const int MAX_PIECES = 4;
+    static const uint8_t LOSS = 128;
+    
+    Tablebase() : values(nullptr) {}
+    Tablebase(const Tablebase&) = delete;
+    Tablebase& operator=(const Tablebase&) = delete;
+    
+    // "KRvKP" -> "KRkp"; both sides need exactly one king
+    static bool parseSignature(const std::string& text, std::string& symbols) {
+        size_t split = text.find('v');
+        if (split == std::string::npos) {
+            return false;
+        }
+        symbols.clear();
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (i == split) continue;
+            char symbol = i < split ? text[i] : static_cast<char>(std::tolower(text[i]));
+            if (std::string("KQRBNPkqrbnp").find(symbol) == std::string::npos) return false;
+            symbols += symbol;
+        }
+        return symbols.size() <= MAX_PIECES && std::count(symbols.begin(), symbols.end(), 'K') == 1 &&
+               std::count(symbols.begin(), symbols.end(), 'k') == 1;
+    }
+    
+    // Canonical signature of a piece list: each side in KQRBNP order
+    static std::string signatureOf(const std::string& symbols) {
+        static const std::string order = "KQRBNP";
+        std::string white, black;
+        for (char type : order) {
+            white.append(std::count(symbols.begin(), symbols.end(), type), type);
+            black.append(std::count(symbols.begin(), symbols.end(), static_cast<char>(std::tolower(type))), type);
+        }
+        return white + "v" + black;
+    }
+    
+    static size_t indexOf(const int* squares, size_t count, bool whiteToMove) {
+        size_t index = whiteToMove ? 0 : 1;
+        for (size_t i = count; i-- > 0;) {
+            index = (index << 6) | static_cast<size_t>(squares[i]);
+        }
+        return index;
+    }
+    
+    void assign(const std::string& text, const std::string& symbols, std::vector<uint8_t>&& data) {
+        signature = text;
+        pieces = symbols;
+        owned = std::move(data);
+        values = owned.data();
+    }
+    
+    bool open(const std::string& path) {
+        if (!file.open(path, MappedFile::Access::Random) || file.size() < 16 || std::memcmp(file.begin(), "COTB", 4) != 0) {
+            return false;
+        }
+        std::string text(file.begin() + 8, strnlen(file.begin() + 8, 8));
+        size_t count = static_cast<unsigned char>(file.begin()[4]);
+        if (!parseSignature(text, pieces) || pieces.size() != count || file.size() != 16 + size()) {
+            return false;
+        }
+        signature = text;
+        values = reinterpret_cast<const uint8_t*>(file.begin() + 16);
+        return true;
+    }
+    
+    bool write(const std::string& path) const {
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        char header[16] = {'C', 'O', 'T', 'B', static_cast<char>(pieces.size())};
+        std::memcpy(header + 8, signature.data(), std::min<size_t>(8, signature.size()));
+        std::fwrite(header, 1, sizeof(header), out);
+        std::fwrite(values, 1, size(), out);
+        return std::fclose(out) == 0;
+    }
+    
+    const std::string& getSignature() const { return signature; }
+    const std::string& getPieces() const { return pieces; }
+    size_t size() const { return static_cast<size_t>(2) << (6 * pieces.size()); }
+    uint8_t value(size_t index) const { return values[index]; }
+};
+
+class TablebaseSet {
+private:
+    std::map<std::string, std::unique_ptr<Tablebase>> tables;
+    size_t maxPieces;
+    
+public:
+    TablebaseSet() : maxPieces(0) {}
+    
+    bool empty() const { return tables.empty(); }
+    void clear() { tables.clear(); maxPieces = 0; }
+    
+    const Tablebase* find(const std::string& signature) const {
+        auto it = tables.find(signature);
+        return it == tables.end() ? nullptr : it->second.get();
+    }
+    
+    void add(std::unique_ptr<Tablebase> table) {
+        maxPieces = std::max(maxPieces, table->getPieces().size());
+        std::string signature = table->getSignature();
+        tables[signature] = std::move(table);
+    }
+    
+    // Maps every *.cotb file in the directory; returns the number of tables loaded
+    size_t loadDirectory(const std::string& path) {
+        size_t loaded = 0;
+        DIR* dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return 0;
+        }
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".cotb") == 0) {
+                std::unique_ptr<Tablebase> table(new Tablebase());
+                if (table->open(path + "/" + name)) {
+                    add(std::move(table));
+                    ++loaded;
+                }
+            }
+        }
+        closedir(dir);
+        return loaded;
+    }
+    
+    // Looks the position up and returns its value byte; false if no table covers it
+    bool probe(const ChessBoard& board, uint8_t& value) const {
+        if (tables.empty()) {
+            return false;
+        }
+        char symbols[Tablebase::MAX_PIECES];
+        int squares[Tablebase::MAX_PIECES];
+        size_t count = 0;
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                const ChessPiece* piece = board.getPiece(x, y);
+                if (piece == nullptr) continue;
+                if (count == maxPieces) return false;
+                symbols[count] = piece->getSymbol();
+                squares[count++] = y * 8 + x;
+            }
+        }
+        
+        const Tablebase* table = find(Tablebase::signatureOf(std::string(symbols, count)));
+        if (table == nullptr) {
+            return false;
+        }
+        // Put the squares in the table's piece order; equal pieces may go in either order
+        const std::string& order = table->getPieces();
+        int ordered[Tablebase::MAX_PIECES];
+        bool used[Tablebase::MAX_PIECES] = {};
+        for (size_t i = 0; i < order.size(); ++i) {
+            for (size_t j = 0; j < count; ++j) {
+                if (!used[j] && symbols[j] == order[i]) {
+                    used[j] = true;
+                    ordered[i] = squares[j];
+                    break;
+                }
+            }
+        }
+        value = table->value(Tablebase::indexOf(ordered, count, board.isWhiteToMove()));
+        return true;
+    }
+};
+
+// Retrograde generation. An initial pass walks every position once, counts its quiet moves
+// and resolves captures through smaller tables (generated first). Results then spread
+// backwards level by level through un-moves: a predecessor of a loss in n-1 is a win in n,
+// and a position whose last unresolved move leads to an opponent win becomes a loss. Both
+// passes are split across threads.
+class TablebaseGenerator {
+private:
+    TablebaseSet& tables;
+    unsigned threads;
+    
+    enum : uint8_t { INVALID = 1, RESOLVED = 2, HAS_DRAW = 4, HAS_WIN = 8 };
+    
+    struct Scratch {
+        std::vector<std::unique_ptr<ChessPiece>> pieces;
+        std::vector<std::vector<ChessPiece*>> grid;
+        int squares[Tablebase::MAX_PIECES];
+    };
+    
+    static void setup(Scratch& scratch, const std::string& symbols) {
+        scratch.pieces.clear();
+        for (char symbol : symbols) scratch.pieces.emplace_back(createPiece(symbol));
+        scratch.grid.assign(8, std::vector<ChessPiece*>(8, nullptr));
+    }
+    
+    // Places the pieces of `index` on the grid; false if two share a square
+    static bool place(Scratch& scratch, size_t index, size_t count) {
+        for (auto& row : scratch.grid) std::fill(row.begin(), row.end(), nullptr);
+        for (size_t i = 0; i < count; ++i) {
+            int square = static_cast<int>((index >> (6 * i)) & 63);
+            scratch.squares[i] = square;
+            if (scratch.grid[square >> 3][square & 7] != nullptr) return false;
+            scratch.grid[square >> 3][square & 7] = scratch.pieces[i].get();
+        }
+        return true;
+    }
+    
+    template <typename Work>
+    void parallelFor(size_t total, Work work) {
+        std::vector<std::thread> workers;
+        size_t slice = (total + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t first = std::min(total, t * slice), last = std::min(total, first + slice);
+            workers.emplace_back([&work, t, first, last] { work(t, first, last); });
+        }
+        for (std::thread& worker : workers) worker.join();
+    }
+    
+public:
+    TablebaseGenerator(TablebaseSet& set, unsigned threadCount) : tables(set), threads(std::max(1u, threadCount)) {}
+    
+    bool generate(const std::string& signature) {
+        std::string symbols;
+        if (!Tablebase::parseSignature(signature, symbols)) {
+            std::cout << "Invalid signature " << signature << ".\n";
+            return false;
+        }
+        std::string canonical = Tablebase::signatureOf(symbols);
+        if (tables.find(canonical) != nullptr) {
+            return true;
+        }
+        Tablebase::parseSignature(canonical, symbols);
+        
+        // Every capture of a non-king piece leads into a smaller table
+        std::vector<const Tablebase*> subtables(symbols.size(), nullptr);
+        for (size_t j = 0; j < symbols.size(); ++j) {
+            if (std::tolower(symbols[j]) == 'k') continue;
+            std::string rest = symbols.substr(0, j) + symbols.substr(j + 1);
+            if (!generate(Tablebase::signatureOf(rest))) return false;
+            subtables[j] = tables.find(Tablebase::signatureOf(rest));
+        }
+        
+        auto startTime = std::chrono::steady_clock::now();
+        const size_t count = symbols.size();
+        const size_t total = static_cast<size_t>(2) << (6 * count);
+        std::vector<uint8_t> values(total, 0);
+        std::vector<uint8_t> remaining(total, 0);
+        std::vector<uint8_t> captureLoss(total, 0);
+        std::unique_ptr<std::atomic<uint8_t>[]> flags(new std::atomic<uint8_t>[total]);
+        std::unique_ptr<std::atomic<uint8_t>[]> counters(new std::atomic<uint8_t>[total]);
+        std::vector<std::vector<uint32_t>> pendingWin(128), pendingLoss(128);
+        std::mutex pendingMutex;
+        
+        // Initial pass: count quiet moves and resolve captures
+        parallelFor(total, [&](unsigned, size_t first, size_t last) {
+            Scratch scratch;
+            setup(scratch, symbols);
+            std::vector<std::vector<uint32_t>> localWin(128), localLoss(128);
+            for (size_t index = first; index < last; ++index) {
+                if (!place(scratch, index, count)) {
+                    flags[index].store(INVALID, std::memory_order_relaxed);
+                    counters[index].store(0, std::memory_order_relaxed);
+                    continue;
+                }
+                bool whiteToMove = (index >> (6 * count)) == 0;
+                int quiet = 0, bestWin = 0, worstLoss = 0;
+                uint8_t flag = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    ChessPiece* piece = scratch.pieces[i].get();
+                    if (piece->getIsWhite() != whiteToMove) continue;
+                    int fromX = scratch.squares[i] & 7, fromY = scratch.squares[i] >> 3;
+                    for (int to = 0; to < 64; ++to) {
+                        ChessPiece* target = scratch.grid[to >> 3][to & 7];
+                        if (target != nullptr && target->getIsWhite() == whiteToMove) continue;
+                        if (!isValidPieceMove(piece->getTypeIndex(), fromX, fromY, to & 7, to >> 3, scratch.grid)) continue;
+                        if (target == nullptr) {
+                            ++quiet;
+                            continue;
+                        }
+                        size_t j = 0;
+                        while (scratch.pieces[j].get() != target) ++j;
+                        if (isKing(target)) {
+                            bestWin = 1;
+                            continue;
+                        }
+                        int subSquares[Tablebase::MAX_PIECES];
+                        size_t n = 0;
+                        for (size_t k = 0; k < count; ++k) {
+                            if (k != j) subSquares[n++] = k == i ? to : scratch.squares[k];
+                        }
+                        uint8_t v = subtables[j]->value(Tablebase::indexOf(subSquares, n, !whiteToMove));
+                        if (v == 0) {
+                            flag |= HAS_DRAW;
+                        } else if (v >= Tablebase::LOSS) {
+                            int plies = v - Tablebase::LOSS + 1;
+                            bestWin = bestWin == 0 ? plies : std::min(bestWin, plies);
+                        } else {
+                            worstLoss = std::max(worstLoss, v + 1);
+                        }
+                    }
+                }
+                if (bestWin > 0) {
+                    flag |= HAS_WIN;
+                    localWin[std::min(bestWin, 127)].push_back(static_cast<uint32_t>(index));
+                } else if (quiet == 0 && !(flag & HAS_DRAW)) {
+                    if (worstLoss > 0) localLoss[std::min(worstLoss, 127)].push_back(static_cast<uint32_t>(index));
+                    else flag |= RESOLVED;   // no move at all: a draw
+                }
+                flags[index].store(flag, std::memory_order_relaxed);
+                counters[index].store(static_cast<uint8_t>(quiet), std::memory_order_relaxed);
+                captureLoss[index] = static_cast<uint8_t>(std::min(worstLoss, 127));
+            }
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            for (int level = 0; level < 128; ++level) {
+                pendingWin[level].insert(pendingWin[level].end(), localWin[level].begin(), localWin[level].end());
+                pendingLoss[level].insert(pendingLoss[level].end(), localLoss[level].begin(), localLoss[level].end());
+            }
+        });
+        
+        auto claim = [&](uint32_t index, uint8_t value) {
+            if (flags[index].fetch_or(RESOLVED) & RESOLVED) return false;
+            values[index] = value;
+            return true;
+        };
+        
+        std::vector<uint32_t> current;
+        for (int level = 1; level < 128; ++level) {
+            std::vector<std::vector<uint32_t>> found(threads);
+            std::vector<std::vector<std::pair<int, uint32_t>>> deferred(threads);
+            
+            // Un-moves from the positions resolved at the previous level
+            parallelFor(current.size(), [&](unsigned t, size_t first, size_t last) {
+                Scratch scratch;
+                setup(scratch, symbols);
+                for (size_t c = first; c < last; ++c) {
+                    uint32_t index = current[c];
+                    place(scratch, index, count);
+                    bool whiteToMove = (index >> (6 * count)) == 0;
+                    bool childLost = values[index] >= Tablebase::LOSS;
+                    
+                    for (size_t i = 0; i < count; ++i) {
+                        ChessPiece* piece = scratch.pieces[i].get();
+                        if (piece->getIsWhite() == whiteToMove) continue;
+                        int x = scratch.squares[i] & 7, y = scratch.squares[i] >> 3;
+                        for (int from = 0; from < 64; ++from) {
+                            int fromX = from & 7, fromY = from >> 3;
+                            if (scratch.grid[fromY][fromX] != nullptr) continue;
+                            bool reachable;
+                            if (std::tolower(piece->getSymbol()) == 'p') {
+                                // Pawn moves are not symmetric: undo a push along its file
+                                int direction = piece->getIsWhite() ? -1 : 1;
+                                int startRow = piece->getIsWhite() ? 6 : 1;
+                                reachable = fromX == x && (fromY == y - direction ||
+                                            (fromY == startRow && fromY == y - 2 * direction &&
+                                             scratch.grid[y - direction][x] == nullptr));
+                            } else {
+                                reachable = isValidPieceMove(piece->getTypeIndex(), x, y, fromX, fromY, scratch.grid);
+                            }
+                            if (!reachable) continue;
+                            
+                            int saved = scratch.squares[i];
+                            scratch.squares[i] = from;
+                            uint32_t parent = static_cast<uint32_t>(Tablebase::indexOf(scratch.squares, count, !whiteToMove));
+                            scratch.squares[i] = saved;
+                            
+                            uint8_t parentFlags = flags[parent].load(std::memory_order_relaxed);
+                            if (parentFlags & RESOLVED) continue;
+                            if (childLost) {
+                                if (claim(parent, static_cast<uint8_t>(level))) found[t].push_back(parent);
+                            } else if (counters[parent].fetch_sub(1) == 1 && !(parentFlags & (HAS_DRAW | HAS_WIN))) {
+                                int lossLevel = std::max(level, static_cast<int>(captureLoss[parent]));
+                                if (lossLevel == level) {
+                                    if (claim(parent, static_cast<uint8_t>(Tablebase::LOSS + level))) found[t].push_back(parent);
+                                } else {
+                                    deferred[t].emplace_back(lossLevel, parent);
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+            
+            current.clear();
+            for (unsigned t = 0; t < threads; ++t) {
+                current.insert(current.end(), found[t].begin(), found[t].end());
+                for (const auto& item : deferred[t]) pendingLoss[item.first].push_back(item.second);
+            }
+            for (uint32_t index : pendingWin[level]) {
+                if (claim(index, static_cast<uint8_t>(level))) current.push_back(index);
+            }
+            for (uint32_t index : pendingLoss[level]) {
+                if (claim(index, static_cast<uint8_t>(Tablebase::LOSS + level))) current.push_back(index);
+            }
+            pendingWin[level].clear();
+            pendingLoss[level].clear();
+            
+            bool morePending = false;
+            for (int later = level + 1; later < 128 && !morePending; ++later) {
+                morePending = !pendingWin[later].empty() || !pendingLoss[later].empty();
+            }
+            if (current.empty() && !morePending) {
+                break;
+            }
+            if (level == 127) {
+                std::cout << signature << ": distances beyond 127 plies do not fit the format.\n";
+                return false;
+            }
+        }
+        
+        uint64_t wins = 0, losses = 0;
+        for (size_t index = 0; index < total; ++index) {
+            if (values[index] >= Tablebase::LOSS) ++losses;
+            else if (values[index] > 0) ++wins;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << canonical << ": " << total << " positions, " << wins << " wins, " << losses
+                  << " losses (" << seconds << " s)\n";
+        
+        std::unique_ptr<Tablebase> table(new Tablebase());
+        table->assign(canonical, symbols, std::move(values));
+        tables.add(std::move(table));
+        return true;
+    }
+};
+
+const int MAX_PLY = 64;
+const int MATE_SCORE = 30000;
+const int INFINITE_SCORE = 32000;
+
+struct SearchLimits {
+    int depth = 0;              // 0 means no depth limit
+    int64_t moveTime = 0;       // milliseconds, 0 means not set
+    int64_t whiteTime = 0;
+    int64_t blackTime = 0;
+    int64_t whiteIncrement = 0;
+    int64_t blackIncrement = 0;
+    int movesToGo = 0;
+    uint64_t nodes = 0;         // 0 means no node limit
+    bool infinite = false;
+    bool ponder = false;        // search on the opponent's time until ponderhit
+    int multiPv = 1;            // number of best root lines to report
+    int64_t moveOverhead = 30;  // milliseconds reserved for communication lag
+};
+
+// Soft limit: do not start another iteration past it. Hard limit: abort the search.
+// The soft limit is scaled after every iteration by how settled the root move is.
+class TimeManager {
+private:
+    std::chrono::steady_clock::time_point startTime;
+    int64_t softLimit;
+    int64_t hardLimit;
+    double scale;
+    int stableIterations;
+    int failLows;
+    bool haveBestMove;
+    Move lastBestMove;
+    
+public:
+    // Clock is polled every CHECK_INTERVAL nodes (a power of two)
+    static const uint64_t CHECK_INTERVAL = 1024;
+    
+    TimeManager() : softLimit(0), hardLimit(0), scale(1.0), stableIterations(0), failLows(0),
+                    haveBestMove(false), lastBestMove{0, 0, 0, 0} {}
+    
+    void start(const SearchLimits& limits, bool whiteToMove) {
+        scale = 1.0;
+        stableIterations = 0;
+        failLows = 0;
+        haveBestMove = false;
+        restart(limits, whiteToMove);
+    }
+    
+    // Restarts the clock with new limits but keeps what earlier iterations learned;
+    // used when a ponder search turns into the real one
+    void restart(const SearchLimits& limits, bool whiteToMove) {
+        startTime = std::chrono::steady_clock::now();
+        softLimit = hardLimit = 0;
+        
+        if (limits.infinite || limits.ponder) {
+            return;
+        }
+        if (limits.moveTime > 0) {
+            softLimit = hardLimit = std::max<int64_t>(1, limits.moveTime - limits.moveOverhead);
+            return;
+        }
+        
+        int64_t remaining = whiteToMove ? limits.whiteTime : limits.blackTime;
+        int64_t increment = whiteToMove ? limits.whiteIncrement : limits.blackIncrement;
+        if (remaining <= 0) {
+            return;
+        }
+        
+        int64_t usable = std::max<int64_t>(1, remaining - limits.moveOverhead);
+        int movesLeft = limits.movesToGo > 0 ? std::min(limits.movesToGo, 40) : 40;
+        int64_t optimum = usable / movesLeft + increment * 3 / 4;
+        
+        // Never plan to spend more than a fraction of the clock on one move, less so when
+        // many moves remain before the next time control
+        int64_t ceiling = movesLeft == 1 ? usable * 9 / 10 : usable * 2 / 5;
+        hardLimit = std::max<int64_t>(1, std::min(optimum * 4, ceiling));
+        softLimit = std::max<int64_t>(1, std::min(optimum, hardLimit));
+    }
+    
+    int64_t elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count();
+    }
+    
+    bool isTimed() const { return hardLimit > 0; }
+    int64_t getHardLimit() const { return hardLimit; }
+    bool hardLimitReached() const { return hardLimit > 0 && elapsed() >= hardLimit; }
+    
+    void onFailLow() { ++failLows; }
+    
+    // Called after every completed iteration with the current root move
+    void onIteration(const Move& bestMove) {
+        if (haveBestMove && bestMove == lastBestMove) {
+            ++stableIterations;
+        } else {
+            stableIterations = 0;
+        }
+        bool changed = haveBestMove && bestMove != lastBestMove;
+        haveBestMove = true;
+        lastBestMove = bestMove;
+        
+        // PV instability and fail-lows buy time, a root move that keeps winning gives it back
+        double instability = changed ? 1.6 : 1.0;
+        double trouble = 1.0 + 0.4 * std::min(failLows, 3);
+        double stability = stableIterations >= 6 ? 0.5 : (stableIterations >= 3 ? 0.75 : 1.0);
+        scale = std::min(3.0, std::max(scale * 0.9, instability * trouble * stability));
+        failLows = 0;
+    }
+    
+    // The next iteration usually costs more than all previous ones, so stop once half
+    // of the adjusted soft limit is gone
+    bool shouldStopIteration() const {
+        if (softLimit == 0) {
+            return false;
+        }
+        int64_t adjusted = std::min<int64_t>(hardLimit, static_cast<int64_t>(softLimit * scale));
+        return elapsed() >= adjusted / 2;
+    }
+};
+
+// Raised by the UCI thread, polled by the search thread
+struct SearchSignals {
+    std::atomic<bool> stop{false};
+    std::atomic<bool> ponder{false};
+};
+
+struct SearchInfo {
+    int multiPv = 1;
+    int depth = 0;
+    int score = 0;
+    uint64_t nodes = 0;
+    int64_t elapsed = 0;
+    std::vector<Move> pv;
+};
+
+// Hot-path counters, compiled in with -DCHESS_STATS. Each Search owns one, so they are plain
+// integers; callers running several searches merge them when reporting.
+#ifdef CHESS_STATS
+#define SEARCH_STAT(statement) statement
+#else
+#define SEARCH_STAT(statement)
+#endif
+
+struct SearchStats {
+    static const int CUTOFF_SLOTS = 8;      // the last slot counts every later move
+    
+    uint64_t nodes = 0;
+    uint64_t qnodes = 0;
+    uint64_t ttHits = 0;
+    uint64_t ttMisses = 0;
+    uint64_t ttCollisions = 0;
+    uint64_t ttCutoffs = 0;
+    uint64_t tbHits = 0;
+    uint64_t evalCalls = 0;
+    uint64_t standPatCutoffs = 0;
+    uint64_t betaCutoffs[CUTOFF_SLOTS] = {};
+    
+    void onBetaCutoff(size_t moveIndex) {
+        ++betaCutoffs[std::min<size_t>(moveIndex, CUTOFF_SLOTS - 1)];
+    }
+    
+    void merge(const SearchStats& other) {
+        nodes += other.nodes;
+        qnodes += other.qnodes;
+        ttHits += other.ttHits;
+        ttMisses += other.ttMisses;
+        ttCollisions += other.ttCollisions;
+        ttCutoffs += other.ttCutoffs;
+        tbHits += other.tbHits;
+        evalCalls += other.evalCalls;
+        standPatCutoffs += other.standPatCutoffs;
+        for (int i = 0; i < CUTOFF_SLOTS; ++i) betaCutoffs[i] += other.betaCutoffs[i];
+    }
+    
+    std::vector<std::pair<const char*, uint64_t>> counters() const {
+        return {{"nodes", nodes}, {"qnodes", qnodes}, {"tt_hits", ttHits}, {"tt_misses", ttMisses},
+                {"tt_collisions", ttCollisions}, {"tt_cutoffs", ttCutoffs}, {"tb_hits", tbHits},
+                {"eval_calls", evalCalls}, {"standpat_cutoffs", standPatCutoffs}};
+    }
+    
+    // One line for "info string"
+    std::string toString() const {
+        std::string text = "stats";
+        for (const auto& counter : counters()) text += std::string(" ") + counter.first + " " + std::to_string(counter.second);
+        text += " beta_cutoffs";
+        for (int i = 0; i < CUTOFF_SLOTS; ++i) text += (i == 0 ? " " : ",") + std::to_string(betaCutoffs[i]);
+        return text;
+    }
+    
+    std::string toJson() const {
+        std::string text = "{";
+        for (const auto& counter : counters()) text += std::string("\"") + counter.first + "\": " + std::to_string(counter.second) + ", ";
+        text += "\"beta_cutoffs\": [";
+        for (int i = 0; i < CUTOFF_SLOTS; ++i) text += (i == 0 ? "" : ", ") + std::to_string(betaCutoffs[i]);
+        return text + "]}";
+    }
+};
+
+class Search {
+private:
+    ChessBoard board;
+    EvalCache& evalCache;
+    TranspositionTable& tt;
+    SearchSignals& signals;
+    const TablebaseSet* tablebases;
+    
+    SearchLimits limits;
+    bool rootWhiteToMove;
+    bool pondering;
+    std::chrono::steady_clock::time_point startTime;
+    TimeManager timeManager;
+    uint64_t nodeLimit;
+    uint64_t nodes;
+    bool aborted;
+#ifdef CHESS_STATS
+    SearchStats stats;
+#endif
+    
+    std::vector<Move> moveLists[MAX_PLY];
+    std::vector<int> scoreLists[MAX_PLY];
+    Move pvTable[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+    std::vector<Move> previousPv;
+    std::vector<Move> excludedRootMoves;
+    
+    // Reported time covers pondering too; the time manager only counts from ponderhit
+    int64_t elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count();
+    }
+    
+    // Clock and stop flag are polled at a fixed node interval to keep the check off the hot path
+    bool shouldStop() {
+        if (!aborted && (nodes & (TimeManager::CHECK_INTERVAL - 1)) == 0) {
+            if (pondering && !signals.ponder.load(std::memory_order_relaxed)) {
+                // The limits now describe a normal timed search; restart ignores ponder ones
+                pondering = false;
+                limits.ponder = false;
+                timeManager.restart(limits, rootWhiteToMove);
+            }
+            if (signals.stop.load(std::memory_order_relaxed) ||
+                timeManager.hardLimitReached() ||
+                (nodeLimit > 0 && nodes >= nodeLimit)) {
+                aborted = true;
+            }
+        }
+        return aborted;
+    }
+    
+    // Hash move, then previous PV move, then captures by most valuable victim / least valuable attacker
+    void scoreMoves(int ply, const Move* hashMove = nullptr) {
+        static const int orderValues[6] = {1, 3, 3, 5, 9, 20};
+        const std::vector<Move>& moves = moveLists[ply];
+        std::vector<int>& scores = scoreLists[ply];
+        scores.resize(moves.size());
+        
+        for (size_t i = 0; i < moves.size(); ++i) {
+            const Move& move = moves[i];
+            int victim = board.pieceAt(move.toY * 8 + move.toX);
+            if (hashMove != nullptr && move == *hashMove) {
+                scores[i] = 2000000;
+            } else if (ply < static_cast<int>(previousPv.size()) && move == previousPv[ply]) {
+                scores[i] = 1000000;
+            } else if (victim != 0) {
+                int attacker = (board.pieceAt(move.fromY * 8 + move.fromX) - 1) % 6;
+                scores[i] = 1000 + 10 * orderValues[(victim - 1) % 6] - orderValues[attacker];
+            } else {
+                scores[i] = 0;
+            }
+        }
+    }
+    
+    const Move& pickMove(int ply, size_t index) {
+        std::vector<Move>& moves = moveLists[ply];
+        std::vector<int>& scores = scoreLists[ply];
+        size_t best = index;
+        for (size_t i = index + 1; i < moves.size(); ++i) {
+            if (scores[i] > scores[best]) best = i;
+        }
+        std::swap(moves[index], moves[best]);
+        std::swap(scores[index], scores[best]);
+        return moves[index];
+    }
+    
+    void updatePv(int ply, const Move& move) {
+        pvTable[ply][ply] = move;
+        for (int i = ply + 1; i < pvLength[ply + 1]; ++i) {
+            pvTable[ply][i] = pvTable[ply + 1][i];
+        }
+        pvLength[ply] = pvLength[ply + 1];
+    }
+    
+    int quiescence(int ply, int alpha, int beta) {
+        pvLength[ply] = ply;
+        ++nodes;
+        SEARCH_STAT(++stats.qnodes);
+        if (shouldStop()) {
+            return 0;
+        }
+        
+        int standPat = board.evaluate(evalCache);
+        SEARCH_STAT(++stats.evalCalls);
+        if (ply >= MAX_PLY - 1 || standPat >= beta) {
+            SEARCH_STAT(stats.standPatCutoffs += standPat >= beta);
+            return standPat;
+        }
+        if (standPat > alpha) {
+            alpha = standPat;
+        }
+        
+        board.generateMoves(moveLists[ply], true);
+        scoreMoves(ply);
+        for (size_t i = 0; i < moveLists[ply].size(); ++i) {
+            Move move = pickMove(ply, i);
+            ChessPiece* captured = board.doMove(move);
+            int score;
+            if (isKing(captured)) {
+                pvLength[ply + 1] = ply + 1;
+                score = MATE_SCORE - ply - 1;
+            } else {
+                score = -quiescence(ply + 1, -beta, -alpha);
+            }
+            board.undoMove(move, captured);
+            
+            if (aborted) {
+                return 0;
+            }
+            if (score > alpha) {
+                alpha = score;
+                updatePv(ply, move);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+        return alpha;
+    }
+    
+    // Mate scores are stored relative to the node so they stay valid at any ply
+    static int scoreToHash(int score, int ply) {
+        if (score >= MATE_SCORE - MAX_PLY) return score + ply;
+        if (score <= -MATE_SCORE + MAX_PLY) return score - ply;
+        return score;
+    }
+    
+    static int scoreFromHash(int score, int ply) {
+        if (score >= MATE_SCORE - MAX_PLY) return score - ply;
+        if (score <= -MATE_SCORE + MAX_PLY) return score + ply;
+        return score;
+    }
+    
+    bool isExcludedRootMove(int ply, const Move& move) const {
+        return ply == 0 && std::find(excludedRootMoves.begin(), excludedRootMoves.end(), move) != excludedRootMoves.end();
+    }
+    
+    int alphaBeta(int depth, int ply, int alpha, int beta) {
+        if (depth <= 0) {
+            return quiescence(ply, alpha, beta);
+        }
+        pvLength[ply] = ply;
+        ++nodes;
+        SEARCH_STAT(++stats.nodes);
+        if (shouldStop()) {
+            return 0;
+        }
+        if (ply >= MAX_PLY - 1) {
+            SEARCH_STAT(++stats.evalCalls);
+            return board.evaluate(evalCache);
+        }
+        
+        uint8_t tableValue;
+        if (ply > 0 && tablebases != nullptr && tablebases->probe(board, tableValue)) {
+            SEARCH_STAT(++stats.tbHits);
+            if (tableValue == 0) return 0;
+            if (tableValue < Tablebase::LOSS) return MATE_SCORE - ply - tableValue;
+            return -(MATE_SCORE - ply - (tableValue - Tablebase::LOSS));
+        }
+        
+        // The root is never cut off so every MultiPV line gets a real search
+        uint64_t key = board.getHash();
+        Move hashMove{0, 0, 0, 0};
+        bool haveHashMove = false;
+        if (const TranspositionTable::Entry* entry = tt.probe(key)) {
+            SEARCH_STAT(++stats.ttHits);
+            hashMove = Move::unpack(entry->move);
+            haveHashMove = true;
+            int hashScore = scoreFromHash(entry->score, ply);
+            if (ply > 0 && entry->depth >= depth &&
+                (entry->bound == TranspositionTable::BOUND_EXACT ||
+                 (entry->bound == TranspositionTable::BOUND_LOWER && hashScore >= beta) ||
+                 (entry->bound == TranspositionTable::BOUND_UPPER && hashScore <= alpha))) {
+                SEARCH_STAT(++stats.ttCutoffs);
+                return hashScore;
+            }
+        } else {
+            SEARCH_STAT(++(tt.collides(key) ? stats.ttCollisions : stats.ttMisses));
+        }
+        
+        board.generateMoves(moveLists[ply]);
+        if (moveLists[ply].empty()) {
+            return 0;
+        }
+        scoreMoves(ply, haveHashMove ? &hashMove : nullptr);
+        
+        int originalAlpha = alpha;
+        int bestScore = -INFINITE_SCORE;
+        Move bestMove = moveLists[ply][0];
+        for (size_t i = 0; i < moveLists[ply].size(); ++i) {
+            Move move = pickMove(ply, i);
+            if (isExcludedRootMove(ply, move)) {
+                continue;
+            }
+            ChessPiece* captured = board.doMove(move);
+            int score;
+            if (isKing(captured)) {
+                pvLength[ply + 1] = ply + 1;
+                score = MATE_SCORE - ply - 1;
+            } else {
+                score = -alphaBeta(depth - 1, ply + 1, -beta, -alpha);
+            }
+            board.undoMove(move, captured);
+            
+            if (aborted) {
+                return 0;
+            }
+            if (score > bestScore) {
+                bestScore = score;
+                bestMove = move;
+                if (score > alpha) {
+                    alpha = score;
+                    updatePv(ply, move);
+                    if (alpha >= beta) {
+                        SEARCH_STAT(stats.onBetaCutoff(i));
+                        break;
+                    }
+                }
+            }
+        }
+        
+        // A root searched with exclusions does not describe the position as a whole
+        if (ply > 0 || excludedRootMoves.empty()) {
+            TranspositionTable::Bound bound = bestScore >= beta ? TranspositionTable::BOUND_LOWER
+                                            : bestScore > originalAlpha ? TranspositionTable::BOUND_EXACT
+                                            : TranspositionTable::BOUND_UPPER;
+            tt.store(key, bestMove, scoreToHash(bestScore, ply), depth, bound);
+        }
+        return bestScore;
+    }
+    
+    // Root search of one line with an aspiration window around its previous score
+    int searchRoot(int depth, int previousScore, bool reportFailLows) {
+        int alpha = -INFINITE_SCORE;
+        int beta = INFINITE_SCORE;
+        int delta = 40;
+        if (depth >= 4 && std::abs(previousScore) < MATE_SCORE - MAX_PLY) {
+            alpha = previousScore - delta;
+            beta = previousScore + delta;
+        }
+        
+        while (true) {
+            int score = alphaBeta(depth, 0, alpha, beta);
+            if (aborted) {
+                return score;
+            }
+            if (score <= alpha) {
+                if (reportFailLows) {
+                    timeManager.onFailLow();
+                }
+                beta = (alpha + beta) / 2;
+                alpha = std::max(score - delta, -INFINITE_SCORE);
+            } else if (score >= beta) {
+                beta = std::min(score + delta, INFINITE_SCORE);
+            } else {
+                return score;
+            }
+            delta *= 2;
+        }
+    }
+    
+    // Hash cutoffs can leave the PV short; fill it in from the table
+    void extendPv(std::vector<Move>& pv, int depth) {
+        std::vector<ChessPiece*> captures;
+        bool kingTaken = false;
+        for (const Move& move : pv) {
+            ChessPiece* captured = board.doMove(move);
+            captures.push_back(captured);
+            kingTaken = kingTaken || isKing(captured);
+        }
+        
+        while (!kingTaken && static_cast<int>(pv.size()) < depth) {
+            const TranspositionTable::Entry* entry = tt.probe(board.getHash());
+            if (entry == nullptr) {
+                break;
+            }
+            Move move = Move::unpack(entry->move);
+            if (!board.isLegalMove(move)) {
+                break;
+            }
+            ChessPiece* captured = board.doMove(move);
+            pv.push_back(move);
+            captures.push_back(captured);
+            kingTaken = isKing(captured);
+        }
+        
+        for (size_t i = pv.size(); i-- > 0;) {
+            board.undoMove(pv[i], captures[i]);
+        }
+    }
+    
+public:
+    Search(const ChessBoard& root, EvalCache& cache, TranspositionTable& table, SearchSignals& searchSignals,
+           const TablebaseSet* endgameTables = nullptr)
+        : board(root), evalCache(cache), tt(table), signals(searchSignals), tablebases(endgameTables),
+          rootWhiteToMove(root.isWhiteToMove()), pondering(false), nodeLimit(0), nodes(0), aborted(false), pvLength() {}
+    
+    // Iterative deepening; each depth searches MultiPV lines in turn, excluding the root
+    // moves of the lines before. onIteration is called for every line of a completed depth.
+    SearchInfo run(const SearchLimits& searchLimits, const std::function<void(const SearchInfo&)>& onIteration) {
+        limits = searchLimits;
+        pondering = limits.ponder;
+        startTime = std::chrono::steady_clock::now();
+        timeManager.start(limits, rootWhiteToMove);
+        nodeLimit = limits.nodes;
+        nodes = 0;
+        aborted = false;
+        SEARCH_STAT(stats = SearchStats());
+        
+        board.generateMoves(moveLists[0]);
+        int lineCount = std::max(1, std::min(limits.multiPv, static_cast<int>(moveLists[0].size())));
+        std::vector<SearchInfo> lines(lineCount);
+        int maxDepth = limits.depth > 0 ? std::min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+        
+        for (int depth = 1; depth <= maxDepth && !aborted; ++depth) {
+            excludedRootMoves.clear();
+            for (int line = 0; line < lineCount; ++line) {
+                previousPv = lines[line].pv;
+                int score = searchRoot(depth, lines[line].score, line == 0);
+                // A partial first iteration is still better than no move at all
+                if (aborted && (depth > 1 || line > 0)) {
+                    break;
+                }
+                
+                SearchInfo& info = lines[line];
+                info.depth = depth;
+                info.score = score;
+                info.pv.assign(pvTable[0], pvTable[0] + pvLength[0]);
+                if (!aborted) {
+                    extendPv(info.pv, depth);
+                }
+                if (info.pv.empty()) {
+                    break;
+                }
+                excludedRootMoves.push_back(info.pv[0]);
+                if (aborted) {
+                    break;
+                }
+            }
+            if (aborted) {
+                break;
+            }
+            
+            std::stable_sort(lines.begin(), lines.end(), [](const SearchInfo& a, const SearchInfo& b) {
+                return a.score > b.score;
+            });
+            for (int line = 0; line < lineCount; ++line) {
+                lines[line].multiPv = line + 1;
+                lines[line].nodes = nodes;
+                lines[line].elapsed = elapsed();
+                onIteration(lines[line]);
+            }
+            
+            if (lineCount == 1 && std::abs(lines[0].score) >= MATE_SCORE - MAX_PLY && !limits.infinite) {
+                break;
+            }
+            if (!lines[0].pv.empty()) {
+                timeManager.onIteration(lines[0].pv[0]);
+            }
+            if (timeManager.shouldStopIteration()) {
+                break;
+            }
+        }
+        
+        SearchInfo result = lines[0];
+        result.nodes = nodes;
+        result.elapsed = elapsed();
+        if (result.pv.empty() && !moveLists[0].empty()) {
+            board.generateMoves(moveLists[0]);
+            result.pv.push_back(moveLists[0][0]);
+        }
+        return result;
+    }
+    
+#ifdef CHESS_STATS
+    const SearchStats& statistics() const { return stats; }
+#endif
+};
+
+// The 781 Random64 constants of the Polyglot format. They are not part of this tree, so they
+// are loaded from a text file of hex values (the array from polyglot's source or any copy of
+// it works; "0x", "ULL" and commas are ignored) and checked against the known start key.
+class PolyglotKeys {
+private:
+    std::vector<uint64_t> random;
+    
+public:
+    static const uint64_t START_POSITION_KEY = 0x463B96181691FC9CULL;
+    
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        std::vector<uint64_t> values;
+        std::string token;
+        while (in >> token && values.size() < 781) {
+            size_t start = token.find("0x");
+            start = start == std::string::npos ? 0 : start + 2;
+            size_t length = 0;
+            while (start + length < token.size() && std::isxdigit(static_cast<unsigned char>(token[start + length]))) ++length;
+            if (length == 16) {
+                values.push_back(std::strtoull(token.substr(start, length).c_str(), nullptr, 16));
+            }
+        }
+        random.swap(values);
+        ChessBoard board;
+        if (random.size() != 781 || key(board) != START_POSITION_KEY) {
+            random.clear();
+            return false;
+        }
+        return true;
+    }
+    
+    bool isLoaded() const { return !random.empty(); }
+    
+    // ChessBoard tracks neither castling rights nor en passant, so castling rights are inferred
+    // from kings and rooks standing on their original squares, and en passant never applies
+    uint64_t key(const ChessBoard& board) const {
+        static const std::string kinds = "pPnNbBrRqQkK";
+        uint64_t h = 0;
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                const ChessPiece* piece = board.getPiece(x, y);
+                if (piece != nullptr) {
+                    size_t kind = kinds.find(piece->getSymbol());
+                    h ^= random[64 * kind + 8 * (7 - y) + x];
+                }
+            }
+        }
+        auto has = [&](int x, int y, char symbol) {
+            return board.getPiece(x, y) != nullptr && board.getPiece(x, y)->getSymbol() == symbol;
+        };
+        if (has(4, 7, 'K') && has(7, 7, 'R')) h ^= random[768];
+        if (has(4, 7, 'K') && has(0, 7, 'R')) h ^= random[769];
+        if (has(4, 0, 'k') && has(7, 0, 'r')) h ^= random[770];
+        if (has(4, 0, 'k') && has(0, 0, 'r')) h ^= random[771];
+        if (board.isWhiteToMove()) h ^= random[780];
+        return h;
+    }
+};
+
+struct BookMove {
+    Move move;
+    uint16_t weight;
+};
+
+// Polyglot .bin book: 16-byte big-endian entries (key, move, weight, learn) sorted by key.
+// The file is mapped, never read in full; a probe is one binary search.
+class PolyglotBook {
+private:
+    MappedFile file;
+    PolyglotKeys keys;
+    std::mt19937 random;
+    
+    static uint64_t readBigEndian(const char* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(in[i]);
+        }
+        return value;
+    }
+    
+    size_t entryCount() const { return file.size() / 16; }
+    uint64_t keyAt(size_t i) const { return readBigEndian(file.begin() + i * 16, 8); }
+    
+public:
+    PolyglotBook() : random(std::random_device{}()) {}
+    
+    bool open(const std::string& bookPath, const std::string& keysPath) {
+        return keys.load(keysPath) && file.open(bookPath, MappedFile::Access::Random) && file.size() % 16 == 0;
+    }
+    
+    bool isOpen() const { return keys.isLoaded() && file.size() > 0; }
+    
+    // Book moves for the position that are legal under ChessBoard's rules
+    void probe(const ChessBoard& board, std::vector<BookMove>& moves) const {
+        moves.clear();
+        if (!isOpen()) {
+            return;
+        }
+        uint64_t key = keys.key(board);
+        size_t low = 0, high = entryCount();
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (keyAt(middle) < key) low = middle + 1;
+            else high = middle;
+        }
+        for (size_t i = low; i < entryCount() && keyAt(i) == key; ++i) {
+            const char* entry = file.begin() + i * 16;
+            unsigned encoded = static_cast<unsigned>(readBigEndian(entry + 8, 2));
+            Move move{static_cast<int>((encoded >> 6) & 7), 7 - static_cast<int>((encoded >> 9) & 7),
+                      static_cast<int>(encoded & 7), 7 - static_cast<int>((encoded >> 3) & 7)};
+            uint16_t weight = static_cast<uint16_t>(readBigEndian(entry + 10, 2));
+            if (weight > 0 && board.isLegalMove(move)) {
+                moves.push_back(BookMove{move, weight});
+            }
+        }
+    }
+    
+    // Picks a move with probability proportional to its weight
+    bool pick(const ChessBoard& board, Move& move) {
+        std::vector<BookMove> moves;
+        probe(board, moves);
+        uint32_t total = 0;
+        for (const BookMove& candidate : moves) total += candidate.weight;
+        if (total == 0) {
+            return false;
+        }
+        uint32_t roll = std::uniform_int_distribution<uint32_t>(0, total - 1)(random);
+        for (const BookMove& candidate : moves) {
+            if (roll < candidate.weight) {
+                move = candidate.move;
+                return true;
+            }
+            roll -= candidate.weight;
+        }
+        return false;
+    }
+};
+
+// UCI score text: "cp 35" or "mate -3"
+std::string formatScore(int score) {
+    if (std::abs(score) >= MATE_SCORE - MAX_PLY) {
+        int plies = MATE_SCORE - std::abs(score);
+        int moves = (plies + 1) / 2;
+        return "mate " + std::to_string(score > 0 ? moves : -moves);
+    }
+    return "cp " + std::to_string(score);
+}
+
+// Splits a command line into whitespace separated tokens without copying it
+class TokenReader {
+private:
+    const char* current;
+    const char* end;
+    
+    void skipSpaces() {
+        while (current != end && std::isspace(static_cast<unsigned char>(*current))) ++current;
+    }
+    
+public:
+    explicit TokenReader(const std::string& line) : current(line.data()), end(line.data() + line.size()) {}
+    
+    bool empty() {
+        skipSpaces();
+        return current == end;
+    }
+    
+    std::string_view next() {
+        skipSpaces();
+        const char* start = current;
+        while (current != end && !std::isspace(static_cast<unsigned char>(*current))) ++current;
+        return std::string_view(start, static_cast<size_t>(current - start));
+    }
+    
+    int64_t nextInt() {
+        std::string_view token = next();
+        int64_t value = 0;
+        bool negative = !token.empty() && token[0] == '-';
+        for (size_t i = negative ? 1 : 0; i < token.size() && std::isdigit(static_cast<unsigned char>(token[i])); ++i) {
+            value = value * 10 + (token[i] - '0');
+        }
+        return negative ? -value : value;
+    }
+};
+
+class UciEngine {
+private:
+    ChessBoard position;
+    std::string positionBase;
+    std::vector<Move> positionMoves;
+    std::vector<Move> pendingMoves;
+    
+    size_t evalCacheKb;
+    size_t hashMb;
+    int64_t moveOverhead;
+    int multiPv;
+    EvalCache evalCache;
+    TranspositionTable tt;
+    bool ownBook;
+    std::string bookFile;
+    std::string bookKeysFile;
+    PolyglotBook book;
+    TablebaseSet tablebases;
+    std::thread searchThread;
+    SearchSignals signals;
+    std::mutex outputMutex;
+    
+    void send(const std::string& line) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << line << std::endl;
+    }
+    
+    void stopSearch() {
+        signals.stop = true;
+        if (searchThread.joinable()) {
+            searchThread.join();
+        }
+    }
+    
+    void sendInfo(const SearchInfo& info) {
+        std::string line = "info depth " + std::to_string(info.depth) +
+                           " multipv " + std::to_string(info.multiPv) +
+                           " score " + formatScore(info.score) +
+                           " nodes " + std::to_string(info.nodes) +
+                           " nps " + std::to_string(info.elapsed > 0 ? info.nodes * 1000 / info.elapsed : info.nodes) +
+                           " time " + std::to_string(info.elapsed) + " pv";
+        for (const Move& move : info.pv) {
+            line += ' ';
+            line += move.toString();
+        }
+        send(line);
+    }
+    
+    // "position [startpos | fen <fen>] [moves ...]". When the base position is unchanged and
+    // the previous move list is a prefix of the new one, only the new moves are played.
+    void handlePosition(TokenReader& tokens) {
+        std::string_view token = tokens.next();
+        std::string base;
+        if (token == "startpos") {
+            base = START_FEN;
+            token = tokens.next();
+        } else if (token == "fen") {
+            for (token = tokens.next(); !token.empty() && token != "moves"; token = tokens.next()) {
+                if (!base.empty()) base += ' ';
+                base.append(token.data(), token.size());
+            }
+        } else {
+            return;
+        }
+        
+        pendingMoves.clear();
+        if (token == "moves") {
+            Move move;
+            for (token = tokens.next(); !token.empty(); token = tokens.next()) {
+                if (!Move::parse(token, move)) {
+                    send("info string invalid move " + std::string(token));
+                    break;
+                }
+                pendingMoves.push_back(move);
+            }
+        }
+        
+        size_t start = 0;
+        if (base == positionBase && pendingMoves.size() >= positionMoves.size() &&
+            std::equal(positionMoves.begin(), positionMoves.end(), pendingMoves.begin())) {
+            start = positionMoves.size();
+        } else if (!position.loadFen(base)) {
+            send("info string invalid fen " + base);
+            position.loadFen(START_FEN);
+            positionBase = START_FEN;
+            positionMoves.clear();
+            return;
+        }
+        
+        for (size_t i = start; i < pendingMoves.size(); ++i) {
+            if (!position.applyMove(pendingMoves[i])) {
+                send("info string illegal move " + pendingMoves[i].toString());
+                pendingMoves.resize(i);
+                break;
+            }
+        }
+        positionBase.swap(base);
+        positionMoves.swap(pendingMoves);
+    }
+    
+    void handleGo(TokenReader& tokens) {
+        SearchLimits limits;
+        limits.moveOverhead = moveOverhead;
+        limits.multiPv = multiPv;
+        for (std::string_view token = tokens.next(); !token.empty(); token = tokens.next()) {
+            if (token == "depth") limits.depth = static_cast<int>(tokens.nextInt());
+            else if (token == "movetime") limits.moveTime = tokens.nextInt();
+            else if (token == "wtime") limits.whiteTime = tokens.nextInt();
+            else if (token == "btime") limits.blackTime = tokens.nextInt();
+            else if (token == "winc") limits.whiteIncrement = tokens.nextInt();
+            else if (token == "binc") limits.blackIncrement = tokens.nextInt();
+            else if (token == "movestogo") limits.movesToGo = static_cast<int>(tokens.nextInt());
+            else if (token == "nodes") limits.nodes = static_cast<uint64_t>(tokens.nextInt());
+            else if (token == "infinite") limits.infinite = true;
+            else if (token == "ponder") limits.ponder = true;
+        }
+        
+        stopSearch();
+        
+        // A book move is played at once; analysis and pondering always search
+        Move bookMove;
+        if (ownBook && !limits.infinite && !limits.ponder && book.pick(position, bookMove)) {
+            send("info string book move " + bookMove.toString());
+            send("bestmove " + bookMove.toString());
+            return;
+        }
+        
+        signals.stop = false;
+        signals.ponder = limits.ponder;
+        // The board is copied here so later position commands cannot race with the search
+        std::unique_ptr<Search> search(new Search(position, evalCache, tt, signals, &tablebases));
+        searchThread = std::thread([this, limits](std::unique_ptr<Search> owned) {
+            SearchInfo result = owned->run(limits, [this](const SearchInfo& info) { sendInfo(info); });
+            SEARCH_STAT(send("info string " + owned->statistics().toString()));
+            // bestmove may only be sent after "stop" in infinite mode, and after "stop" or
+            // "ponderhit" while pondering
+            while ((limits.infinite || signals.ponder) && !signals.stop) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::string line = "bestmove " + (result.pv.empty() ? std::string("0000") : result.pv[0].toString());
+            if (result.pv.size() > 1) {
+                line += " ponder " + result.pv[1].toString();
+            }
+            send(line);
+        }, std::move(search));
+    }
+    
+    void handleSetOption(TokenReader& tokens) {
+        std::string name, value;
+        std::string* field = nullptr;
+        for (std::string_view token = tokens.next(); !token.empty(); token = tokens.next()) {
+            if (token == "name") {
+                field = &name;
+            } else if (token == "value") {
+                field = &value;
+            } else if (field != nullptr) {
+                if (!field->empty()) *field += ' ';
+                field->append(token.data(), token.size());
+            }
+        }
+        
+        if (name == "Hash") {
+            stopSearch();
+            hashMb = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+            tt.resize(hashMb);
+        } else if (name == "MultiPV") {
+            multiPv = std::max(1, std::min(64, std::atoi(value.c_str())));
+        } else if (name == "EvalCache") {
+            stopSearch();
+            evalCacheKb = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+            evalCache.resize(evalCacheKb);
+        } else if (name == "MoveOverhead") {
+            moveOverhead = std::max<int64_t>(0, std::strtoll(value.c_str(), nullptr, 10));
+        } else if (name == "OwnBook" || name == "BookFile" || name == "BookKeys") {
+            if (name == "OwnBook") ownBook = value == "true";
+            else if (name == "BookFile") bookFile = value;
+            else bookKeysFile = value;
+            if (ownBook && !bookFile.empty() && !bookKeysFile.empty() && !book.open(bookFile, bookKeysFile)) {
+                send("info string cannot open book " + bookFile + " with keys " + bookKeysFile);
+            }
+        } else if (name == "TablebasePath") {
+            stopSearch();
+            tablebases.clear();
+            send("info string loaded " + std::to_string(tablebases.loadDirectory(value)) + " tablebases");
+        } else if (name == "Ponder") {
+            // Pondering is driven entirely by "go ponder", nothing to configure
+        } else {
+            send("info string unknown option " + name);
+        }
+    }
+    
+public:
+    UciEngine() : positionBase(START_FEN), evalCacheKb(256), hashMb(16), moveOverhead(30), multiPv(1),
+                  evalCache(evalCacheKb), tt(hashMb), ownBook(false) {
+        position.loadFen(START_FEN);
+    }
+    
+    ~UciEngine() {
+        stopSearch();
+    }
+    
+    // Returns false once "quit" has been received
+    bool handleCommand(const std::string& line) {
+        TokenReader tokens(line);
+        std::string_view command = tokens.next();
+        
+        if (command == "uci") {
+            send("id name C++ Chess");
+            send("id author chess-oopc contributors");
+            send("option name Hash type spin default 16 min 1 max 4096");
+            send("option name EvalCache type spin default 256 min 1 max 65536");
+            send("option name MultiPV type spin default 1 min 1 max 64");
+            send("option name MoveOverhead type spin default 30 min 0 max 5000");
+            send("option name Ponder type check default false");
+            send("option name OwnBook type check default false");
+            send("option name BookFile type string default <empty>");
+            send("option name BookKeys type string default <empty>");
+            send("option name TablebasePath type string default <empty>");
+            send("uciok");
+        } else if (command == "isready") {
+            send("readyok");
+        } else if (command == "ucinewgame") {
+            stopSearch();
+            evalCache.clear();
+            tt.clear();
+        } else if (command == "position") {
+            handlePosition(tokens);
+        } else if (command == "go") {
+            handleGo(tokens);
+        } else if (command == "stop") {
+            stopSearch();
+        } else if (command == "ponderhit") {
+            signals.ponder = false;
+        } else if (command == "setoption") {
+            handleSetOption(tokens);
+        } else if (command == "quit") {
+            stopSearch();
+            return false;
+        } else if (!command.empty()) {
+            send("info string unknown command " + std::string(command));
+        }
+        return true;
+    }
+    
+    void run(std::istream& in) {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!handleCommand(line)) {
+                return;
+            }
+        }
+        stopSearch();
+    }
+};
+
+// Decodes a SAN move ("Nbd7", "exd5", "Qh4+") against the board. Castling, en passant and
+// promotion are rejected because ChessBoard does not implement them. Of the pieces that fit,
+// only those that do not leave their own king attacked count, which is what SAN assumes;
+// the move is accepted only if exactly one remains.
+bool parseSan(ChessBoard& board, std::string_view san, Move& move) {
+    while (!san.empty() && std::strchr("+#!?", san.back()) != nullptr) {
+        san.remove_suffix(1);
+    }
+    if (san.size() < 2 || san[0] == 'O' || san[0] == '0' || san.find('=') != std::string_view::npos) {
+        return false;
+    }
+    
+    char pieceType = 'P';
+    size_t start = 0;
+    if (std::strchr("NBRQK", san[0]) != nullptr) {
+        pieceType = san[0];
+        start = 1;
+    }
+    
+    char file = san[san.size() - 2];
+    char rank = san[san.size() - 1];
+    if (file < 'a' || file > 'h' || rank < '1' || rank > '8') {
+        return false;
+    }
+    int toX = file - 'a';
+    int toY = '8' - rank;
+    
+    int fromFile = -1;
+    int fromRank = -1;
+    for (size_t i = start; i + 2 < san.size(); ++i) {
+        if (san[i] >= 'a' && san[i] <= 'h') fromFile = san[i] - 'a';
+        else if (san[i] >= '1' && san[i] <= '8') fromRank = '8' - san[i];
+        else if (san[i] != 'x') return false;
+    }
+    
+    bool white = board.isWhiteToMove();
+    char symbol = white ? pieceType : static_cast<char>(std::tolower(pieceType));
+    int found = 0;
+    for (int y = 0; y < 8; ++y) {
+        if (fromRank >= 0 && y != fromRank) continue;
+        for (int x = 0; x < 8; ++x) {
+            if (fromFile >= 0 && x != fromFile) continue;
+            const ChessPiece* piece = board.getPiece(x, y);
+            if (piece == nullptr || piece->getSymbol() != symbol) continue;
+            
+            Move candidate{x, y, toX, toY};
+            if (!board.isLegalMove(candidate)) continue;
+            ChessPiece* captured = board.doMove(candidate);
+            bool exposed = false;
+            for (int ky = 0; ky < 8 && !exposed; ++ky) {
+                for (int kx = 0; kx < 8; ++kx) {
+                    const ChessPiece* king = board.getPiece(kx, ky);
+                    if (isKing(king) && king->getIsWhite() == white) {
+                        exposed = board.isSquareAttacked(kx, ky, !white);
+                        break;
+                    }
+                }
+            }
+            board.undoMove(candidate, captured);
+            if (exposed) continue;
+            move = candidate;
+            ++found;
+        }
+    }
+    return found == 1;
+}
+
+struct PgnTag {
+    std::string_view name;
+    std::string_view value;     // raw, escapes are left in place
+};
+
+// Views point into the parser's input and stay valid as long as it does
+struct PgnGame {
+    std::vector<PgnTag> tags;
+    std::vector<Move> moves;    // main line only
+    std::string_view result;
+    const char* error = nullptr;
+    size_t errorPly = 0;
+    
+    std::string_view tag(std::string_view name) const {
+        for (const PgnTag& tag : tags) {
+            if (tag.name == name) return tag.value;
+        }
+        return std::string_view();
+    }
+};
+
+// Pulls one game at a time out of PGN text held in memory (usually a MappedFile). Tags,
+// comments, NAGs and variations are parsed; variations are skipped rather than replayed.
+// Nothing is allocated per move: tokens are views and the game's vectors are reused.
+class PgnParser {
+private:
+    const char* current;
+    const char* end;
+    ChessBoard board;
+    ChessBoard startBoard;
+    
+    void skipSpaces() {
+        while (current != end && std::isspace(static_cast<unsigned char>(*current))) ++current;
+    }
+    
+    void skipLine() {
+        while (current != end && *current != '\n') ++current;
+    }
+    
+    void skipPast(char closing) {
+        while (current != end && *current != closing) ++current;
+        if (current != end) ++current;
+    }
+    
+    void skipVariation() {
+        int depth = 0;
+        while (current != end) {
+            char c = *current++;
+            if (c == '(') ++depth;
+            else if (c == ')' && --depth == 0) return;
+            else if (c == '{') skipPast('}');
+            else if (c == ';') skipLine();
+        }
+    }
+    
+    bool atLineStart() const {
+        return current[-1] == '\n' || current[-1] == '\r';
+    }
+    
+    void parseTag(PgnGame& game) {
+        ++current;
+        const char* nameStart = current;
+        while (current != end && !std::isspace(static_cast<unsigned char>(*current)) && *current != ']') ++current;
+        std::string_view name(nameStart, static_cast<size_t>(current - nameStart));
+        
+        while (current != end && *current != '"' && *current != ']') ++current;
+        std::string_view value;
+        if (current != end && *current == '"') {
+            const char* valueStart = ++current;
+            while (current != end && *current != '"') {
+                if (*current == '\\' && current + 1 != end) ++current;
+                ++current;
+            }
+            value = std::string_view(valueStart, static_cast<size_t>(current - valueStart));
+        }
+        skipPast(']');
+        game.tags.push_back(PgnTag{name, value});
+    }
+    
+    static bool isResult(std::string_view token) {
+        return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+    }
+    
+public:
+    PgnParser(const char* data, size_t size) : current(data), end(data + size) {
+        // Skip a UTF-8 byte order mark
+        if (size >= 3 && static_cast<unsigned char>(data[0]) == 0xEF &&
+            static_cast<unsigned char>(data[1]) == 0xBB && static_cast<unsigned char>(data[2]) == 0xBF) {
+            current += 3;
+        }
+    }
+    
+    // Returns false when the input is exhausted. Games with an undecodable move are still
+    // returned, with error set and moves holding everything up to that point.
+    bool next(PgnGame& game) {
+        game.tags.clear();
+        game.moves.clear();
+        game.result = std::string_view();
+        game.error = nullptr;
+        game.errorPly = 0;
+        
+        skipSpaces();
+        while (current != end && (*current == '[' || *current == '%' || *current == ';')) {
+            if (*current == '[') parseTag(game);
+            else skipLine();
+            skipSpaces();
+        }
+        if (current == end && game.tags.empty()) {
+            return false;
+        }
+        
+        board = startBoard;
+        std::string_view fen = game.tag("FEN");
+        if (!fen.empty() && !board.loadFen(std::string(fen))) {
+            game.error = "invalid FEN tag";
+        }
+        
+        while (current != end) {
+            char c = *current;
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++current;
+            } else if (c == '{') {
+                skipPast('}');
+            } else if (c == ';') {
+                skipLine();
+            } else if (c == '(') {
+                skipVariation();
+            } else if (c == '$') {
+                ++current;
+                while (current != end && std::isdigit(static_cast<unsigned char>(*current))) ++current;
+            } else if (c == '[' && atLineStart()) {
+                // Next game started without a result token
+                break;
+            } else {
+                const char* tokenStart = current;
+                while (current != end && !std::isspace(static_cast<unsigned char>(*current)) &&
+                       std::strchr("{}();[$", *current) == nullptr) {
+                    ++current;
+                }
+                std::string_view token(tokenStart, static_cast<size_t>(current - tokenStart));
+                if (isResult(token)) {
+                    game.result = token;
+                    break;
+                }
+                
+                // Strip move numbers such as "12." or "12..." glued to the move
+                size_t digits = 0;
+                while (digits < token.size() && std::isdigit(static_cast<unsigned char>(token[digits]))) ++digits;
+                if (digits > 0 && digits < token.size() && token[digits] == '.') {
+                    while (digits < token.size() && token[digits] == '.') ++digits;
+                    token.remove_prefix(digits);
+                } else if (digits == token.size()) {
+                    token = std::string_view();
+                }
+                if (token.empty() || game.error != nullptr) {
+                    continue;
+                }
+                
+                Move move;
+                if (!parseSan(board, token, move)) {
+                    game.error = "unsupported or illegal move";
+                    game.errorPly = game.moves.size();
+                    continue;
+                }
+                delete board.doMove(move);
+                game.moves.push_back(move);
+            }
+        }
+        return true;
+    }
+    
+    const ChessBoard& position() const { return board; }
+};
+
+int replayPgnFile(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "Cannot open " << path << ".\n";
+        return 1;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    PgnParser parser(file.begin(), file.size());
+    PgnGame game;
+    uint64_t games = 0, moves = 0, failed = 0;
+    while (parser.next(game)) {
+        ++games;
+        moves += game.moves.size();
+        if (game.error != nullptr) ++failed;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    
+    std::cout << "Games: " << games << ", moves: " << moves << ", stopped early: " << failed << "\n";
+    std::cout << "Time: " << seconds << " s, "
+              << static_cast<uint64_t>(seconds > 0 ? games / seconds : 0.0) << " games/s\n";
+    return 0;
+}
+
+// Hands items to a single consumer in index order. Producers may finish out of order but
+// block once they get more than `capacity` items ahead of the consumer. When the number of
+// items is not known up front, call setTotal once it is.
+template <typename T>
+class OrderedQueue {
+private:
+    std::map<size_t, T> pending;
+    size_t nextIndex;
+    size_t capacity;
+    size_t total;
+    std::mutex mutex;
+    std::condition_variable changed;
+    
+public:
+    OrderedQueue(size_t capacity, size_t total = SIZE_MAX) : nextIndex(0), capacity(capacity), total(total) {}
+    
+    void setTotal(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total = count;
+        changed.notify_all();
+    }
+    
+    void push(size_t index, T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return index < nextIndex + capacity; });
+        pending.emplace(index, std::move(item));
+        changed.notify_all();
+    }
+    
+    // Returns false once all `total` items have been handed out
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return nextIndex == total || pending.count(nextIndex) != 0; });
+        if (nextIndex == total) {
+            return false;
+        }
+        auto it = pending.find(nextIndex);
+        item = std::move(it->second);
+        pending.erase(it);
+        ++nextIndex;
+        changed.notify_all();
+        return true;
+    }
+};
+
+// Multi-producer, multi-consumer FIFO that blocks producers while full
+template <typename T>
+class BoundedQueue {
+private:
+    std::queue<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable changed;
+    
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+    
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return items.size() < capacity || closed; });
+        items.push(std::move(item));
+        changed.notify_all();
+    }
+    
+    // Returns false once the queue is closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop();
+        changed.notify_all();
+        return true;
+    }
+    
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+    }
+};
+
+unsigned defaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// First game start at or after `from`: the beginning of a line holding an "[Event " tag.
+// Every worker computes chunk edges this way, so chunks need no coordination.
+const char* findGameStart(const char* begin, const char* end, const char* from) {
+    if (from <= begin) {
+        return begin;
+    }
+    static const char marker[] = "\n[Event ";
+    const char* found = std::search(from - 1, end, marker, marker + sizeof(marker) - 1);
+    return found == end ? end : found + 1;
+}
+
+struct PgnChunkResult {
+    std::string output;
+    uint64_t games = 0;
+    uint64_t moves = 0;
+    uint64_t failed = 0;
+};
+
+enum class PgnOutput { None, Hash, Fen };
+
+// Splits a PGN file at game boundaries, replays the chunks on a worker pool and writes one
+// line per game ("<plies> <result> <hash> [<fen>]") to stdout in file order
+int replayPgnFileParallel(const std::string& path, unsigned threads, PgnOutput format) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Cannot open " << path << ".\n";
+        return 1;
+    }
+    
+    const size_t chunkSize = 1 << 20;
+    size_t chunkCount = std::max<size_t>(1, (file.size() + chunkSize - 1) / chunkSize);
+    OrderedQueue<PgnChunkResult> results(threads * 4, chunkCount);
+    std::atomic<size_t> nextChunk(0);
+    auto startTime = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            PgnGame game;
+            char hashText[17];
+            for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+                const char* first = findGameStart(file.begin(), file.end(), file.begin() + std::min(file.size(), chunk * chunkSize));
+                const char* last = findGameStart(file.begin(), file.end(), file.begin() + std::min(file.size(), (chunk + 1) * chunkSize));
+                
+                PgnChunkResult result;
+                PgnParser parser(first, static_cast<size_t>(std::max(first, last) - first));
+                while (parser.next(game)) {
+                    ++result.games;
+                    result.moves += game.moves.size();
+                    if (game.error != nullptr) ++result.failed;
+                    if (format == PgnOutput::None) {
+                        continue;
+                    }
+                    std::snprintf(hashText, sizeof(hashText), "%016llx",
+                                  static_cast<unsigned long long>(parser.position().getHash()));
+                    result.output += std::to_string(game.moves.size());
+                    result.output += ' ';
+                    result.output.append(game.result.empty() ? std::string_view("*") : game.result);
+                    result.output += ' ';
+                    result.output += hashText;
+                    if (format == PgnOutput::Fen) {
+                        result.output += ' ';
+                        result.output += parser.position().toFen();
+                    }
+                    result.output += '\n';
+                }
+                results.push(chunk, std::move(result));
+            }
+        });
+    }
+    
+    uint64_t games = 0, moves = 0, failed = 0;
+    PgnChunkResult result;
+    while (results.pop(result)) {
+        std::fwrite(result.output.data(), 1, result.output.size(), stdout);
+        games += result.games;
+        moves += result.moves;
+        failed += result.failed;
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    std::fflush(stdout);
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cerr << "Games: " << games << ", moves: " << moves << ", stopped early: " << failed
+              << ", threads: " << threads << "\n";
+    std::cerr << "Time: " << seconds << " s, "
+              << static_cast<uint64_t>(seconds > 0 ? games / seconds : 0.0) << " games/s\n";
+    return 0;
+}
+
+enum class GameResult : uint8_t { Unknown, WhiteWins, BlackWins, Draw };
+
+GameResult parseResult(std::string_view text) {
+    if (text == "1-0") return GameResult::WhiteWins;
+    if (text == "0-1") return GameResult::BlackWins;
+    if (text == "1/2-1/2") return GameResult::Draw;
+    return GameResult::Unknown;
+}
+
+const char* resultText(GameResult result) {
+    switch (result) {
+        case GameResult::WhiteWins: return "1-0";
+        case GameResult::BlackWins: return "0-1";
+        case GameResult::Draw: return "1/2-1/2";
+        default: return "*";
+    }
+}
+
+// Little-endian helpers for the binary file formats
+void putLittleEndian(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t getLittleEndian(const char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+// Binary game archive. Every move is one byte: its index in generateMoves() of the position.
+//
+//   file header   "COGB" u16 version u16 reserved
+//   game record   u16 plies, u8 result, u8 flags, [u8 length + start FEN if flags & 1], plies bytes
+//                 (flags & 2 marks a game whose moves stop before the recorded result)
+//   index         u64 offset per game
+//   footer        u64 index offset, u32 game count, "COGI"
+class GameArchiveWriter {
+private:
+    FILE* file;
+    uint64_t offset;
+    std::vector<uint64_t> offsets;
+    std::string record;
+    std::vector<Move> moveList;
+    ChessBoard board;
+    ChessBoard startBoard;
+    
+    void write(const std::string& bytes) {
+        std::fwrite(bytes.data(), 1, bytes.size(), file);
+        offset += bytes.size();
+    }
+    
+public:
+    GameArchiveWriter() : file(nullptr), offset(0) {}
+    GameArchiveWriter(const GameArchiveWriter&) = delete;
+    GameArchiveWriter& operator=(const GameArchiveWriter&) = delete;
+    
+    ~GameArchiveWriter() {
+        close();
+    }
+    
+    bool open(const std::string& path) {
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        offset = 0;
+        offsets.clear();
+        std::string header = "COGB";
+        putLittleEndian(header, 1, 2);
+        putLittleEndian(header, 0, 2);
+        write(header);
+        return true;
+    }
+    
+    // startFen is empty for the standard starting position. Fails (and writes nothing) if a
+    // move is illegal or the game does not fit the format.
+    bool addGame(const std::string& startFen, const std::vector<Move>& moves, GameResult result,
+                 bool truncated = false) {
+        if (moves.size() > 0xFFFF || startFen.size() > 0xFF) {
+            return false;
+        }
+        if (startFen.empty()) {
+            board = startBoard;
+        } else if (!board.loadFen(startFen)) {
+            return false;
+        }
+        
+        record.clear();
+        putLittleEndian(record, moves.size(), 2);
+        record += static_cast<char>(result);
+        record += static_cast<char>((startFen.empty() ? 0 : 1) | (truncated ? 2 : 0));
+        if (!startFen.empty()) {
+            record += static_cast<char>(startFen.size());
+            record += startFen;
+        }
+        for (const Move& move : moves) {
+            board.generateMoves(moveList);
+            auto it = std::find(moveList.begin(), moveList.end(), move);
+            if (it == moveList.end() || it - moveList.begin() > 0xFF) {
+                return false;
+            }
+            record += static_cast<char>(it - moveList.begin());
+            delete board.doMove(move);
+        }
+        
+        offsets.push_back(offset);
+        write(record);
+        return true;
+    }
+    
+    bool close() {
+        if (file == nullptr) {
+            return true;
+        }
+        std::string index;
+        index.reserve(offsets.size() * 8 + 16);
+        for (uint64_t gameOffset : offsets) {
+            putLittleEndian(index, gameOffset, 8);
+        }
+        putLittleEndian(index, offset, 8);
+        putLittleEndian(index, offsets.size(), 4);
+        index += "COGI";
+        write(index);
+        bool ok = std::fclose(file) == 0;
+        file = nullptr;
+        return ok;
+    }
+    
+    size_t gameCount() const { return offsets.size(); }
+};
+
+class GameArchive {
+private:
+    MappedFile file;
+    const char* index;
+    uint64_t indexOffset;       // game records live in [8, indexOffset)
+    size_t count;
+    ChessBoard startBoard;
+    std::vector<Move> moveList;
+    
+public:
+    GameArchive() : index(nullptr), indexOffset(0), count(0) {}
+    
+    // Checks the footer and that every index entry points at a record header inside the
+    // game area; replay checks the rest of each record
+    bool open(const std::string& path) {
+        index = nullptr;
+        count = 0;
+        if (!file.open(path) || file.size() < 24 || std::memcmp(file.begin(), "COGB", 4) != 0 ||
+            std::memcmp(file.end() - 4, "COGI", 4) != 0) {
+            return false;
+        }
+        uint64_t offset = getLittleEndian(file.end() - 16, 8);
+        uint64_t games = getLittleEndian(file.end() - 8, 4);
+        if (offset < 8 || offset > file.size() - 16 || (file.size() - 16 - offset) / 8 != games ||
+            (file.size() - 16 - offset) % 8 != 0) {
+            return false;
+        }
+        for (uint64_t i = 0; i < games; ++i) {
+            uint64_t start = getLittleEndian(file.begin() + offset + i * 8, 8);
+            if (start < 8 || start > offset || offset - start < 4) {
+                return false;
+            }
+        }
+        indexOffset = offset;
+        index = file.begin() + offset;
+        count = static_cast<size_t>(games);
+        return true;
+    }
+    
+    size_t size() const { return count; }
+    
+    // Replays game `gameIndex` onto `board`, calling onMove(board, move) before each move is
+    // played. Returns false if the record is corrupt.
+    template <typename Callback>
+    bool replay(size_t gameIndex, ChessBoard& board, GameResult& result, Callback&& onMove) {
+        if (gameIndex >= count) {
+            return false;
+        }
+        uint64_t offset = getLittleEndian(index + gameIndex * 8, 8);
+        const char* record = file.begin() + offset;
+        size_t plies = static_cast<size_t>(getLittleEndian(record, 2));
+        uint8_t resultByte = static_cast<uint8_t>(record[2]);
+        uint8_t flags = static_cast<uint8_t>(record[3]);
+        uint64_t available = indexOffset - offset - 4;      // open() guarantees the 4-byte header
+        record += 4;
+        if (resultByte > static_cast<uint8_t>(GameResult::Draw)) {
+            return false;
+        }
+        result = static_cast<GameResult>(resultByte);
+        
+        if (flags & 1) {
+            if (available < 1) {
+                return false;
+            }
+            size_t length = static_cast<unsigned char>(*record++);
+            available -= 1;
+            if (available < length || !board.loadFen(std::string(record, length))) {
+                return false;
+            }
+            record += length;
+            available -= length;
+        } else {
+            board = startBoard;
+        }
+        if (available < plies) {
+            return false;
+        }
+        
+        for (size_t ply = 0; ply < plies; ++ply) {
+            board.generateMoves(moveList);
+            size_t moveIndex = static_cast<unsigned char>(record[ply]);
+            if (moveIndex >= moveList.size()) {
+                return false;
+            }
+            onMove(static_cast<const ChessBoard&>(board), moveList[moveIndex]);
+            delete board.doMove(moveList[moveIndex]);
+        }
+        return true;
+    }
+};
+
+int convertPgnToArchive(const std::string& pgnPath, const std::string& archivePath) {
+    MappedFile file;
+    if (!file.open(pgnPath)) {
+        std::cout << "Cannot open " << pgnPath << ".\n";
+        return 1;
+    }
+    GameArchiveWriter writer;
+    if (!writer.open(archivePath)) {
+        std::cout << "Cannot create " << archivePath << ".\n";
+        return 1;
+    }
+    
+    PgnParser parser(file.begin(), file.size());
+    PgnGame game;
+    uint64_t skipped = 0;
+    while (parser.next(game)) {
+        // Games that stop early are kept up to the last good move and flagged as truncated
+        if (!writer.addGame(std::string(game.tag("FEN")), game.moves, parseResult(game.result), game.error != nullptr)) {
+            ++skipped;
+        }
+    }
+    size_t written = writer.gameCount();
+    if (!writer.close()) {
+        std::cout << "Cannot write " << archivePath << ".\n";
+        return 1;
+    }
+    std::cout << "Games written: " << written << ", skipped: " << skipped << "\n";
+    return 0;
+}
+
+int replayArchive(const std::string& path) {
+    GameArchive archive;
+    if (!archive.open(path)) {
+        std::cout << "Cannot open " << path << " as a game archive.\n";
+        return 1;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    ChessBoard board;
+    GameResult result;
+    uint64_t plies = 0, corrupt = 0;
+    for (size_t i = 0; i < archive.size(); ++i) {
+        if (!archive.replay(i, board, result, [&](const ChessBoard&, const Move&) { ++plies; })) {
+            ++corrupt;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    
+    std::cout << "Games: " << archive.size() << ", moves: " << plies << ", corrupt: " << corrupt << "\n";
+    std::cout << "Time: " << seconds << " s, "
+              << static_cast<uint64_t>(seconds > 0 ? archive.size() / seconds : 0.0) << " games/s\n";
+    return 0;
+}
+
+// One occurrence of a position in the archive. Stored raw in host (little-endian) order so
+// the index file can be used in place through mmap.
+struct PositionRecord {
+    uint64_t hash;
+    uint32_t game;
+    uint32_t ply;
+    
+    bool operator<(const PositionRecord& other) const {
+        if (hash != other.hash) return hash < other.hash;
+        if (game != other.game) return game < other.game;
+        return ply < other.ply;
+    }
+};
+
+// Index file: "COPI" u32 reserved u64 count, 65537 u64 bucket starts keyed by the top 16
+// bits of the hash, then the records sorted by (hash, game, ply). The bucket table narrows
+// every lookup to a few pages of the record array.
+class PositionIndex {
+private:
+    MappedFile file;
+    const uint64_t* buckets;
+    const PositionRecord* records;
+    uint64_t count;
+    
+public:
+    static const size_t BUCKET_COUNT = 65536;
+    static const size_t HEADER_SIZE = 16 + (BUCKET_COUNT + 1) * 8;
+    
+    PositionIndex() : buckets(nullptr), records(nullptr), count(0) {}
+    
+    bool open(const std::string& path) {
+        if (!file.open(path, MappedFile::Access::Random) || file.size() < HEADER_SIZE ||
+            std::memcmp(file.begin(), "COPI", 4) != 0) {
+            return false;
+        }
+        std::memcpy(&count, file.begin() + 8, 8);
+        if (HEADER_SIZE + count * sizeof(PositionRecord) != file.size()) {
+            return false;
+        }
+        buckets = reinterpret_cast<const uint64_t*>(file.begin() + 16);
+        records = reinterpret_cast<const PositionRecord*>(file.begin() + HEADER_SIZE);
+        // Lookups trust the bucket table, so it must be ascending and end at the record count
+        if (buckets[0] != 0 || buckets[BUCKET_COUNT] != count) {
+            return false;
+        }
+        for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+            if (buckets[b] > buckets[b + 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    uint64_t size() const { return count; }
+    
+    // All occurrences of `hash`, as a [first, last) range into the mapped file
+    std::pair<const PositionRecord*, const PositionRecord*> find(uint64_t hash) const {
+        size_t bucket = static_cast<size_t>(hash >> 48);
+        const PositionRecord* first = records + buckets[bucket];
+        const PositionRecord* last = records + buckets[bucket + 1];
+        first = std::lower_bound(first, last, hash, [](const PositionRecord& record, uint64_t key) {
+            return record.hash < key;
+        });
+        last = std::upper_bound(first, last, hash, [](uint64_t key, const PositionRecord& record) {
+            return key < record.hash;
+        });
+        return std::make_pair(first, last);
+    }
+};
+
+// Builds the index with an external sort: records are collected into runs of bounded size,
+// each run is sorted and spilled to disk, and the runs are merged into the final file.
+int buildPositionIndex(const std::string& archivePath, const std::string& indexPath, size_t runMb) {
+    GameArchive archive;
+    if (!archive.open(archivePath)) {
+        std::cout << "Cannot open " << archivePath << " as a game archive.\n";
+        return 1;
+    }
+    
+    size_t runCapacity = std::max<size_t>(1, runMb * 1024 * 1024 / sizeof(PositionRecord));
+    std::vector<PositionRecord> run;
+    run.reserve(std::min<size_t>(runCapacity, 1 << 20));
+    std::vector<std::string> runPaths;
+    
+    auto spill = [&]() {
+        std::sort(run.begin(), run.end());
+        std::string runPath = indexPath + ".run" + std::to_string(runPaths.size());
+        FILE* out = std::fopen(runPath.c_str(), "wb");
+        if (out == nullptr || std::fwrite(run.data(), sizeof(PositionRecord), run.size(), out) != run.size()) {
+            if (out != nullptr) std::fclose(out);
+            return false;
+        }
+        std::fclose(out);
+        runPaths.push_back(runPath);
+        run.clear();
+        return true;
+    };
+    
+    ChessBoard board;
+    GameResult result;
+    bool ok = true;
+    uint64_t corrupt = 0;
+    for (size_t game = 0; game < archive.size() && ok; ++game) {
+        uint32_t ply = 0;
+        size_t runStart = run.size();
+        if (!archive.replay(game, board, result, [&](const ChessBoard& position, const Move&) {
+                run.push_back(PositionRecord{position.getHash(), static_cast<uint32_t>(game), ply++});
+            })) {
+            // Drop what the corrupt record produced before it failed
+            run.resize(runStart);
+            ++corrupt;
+            continue;
+        }
+        // The final position of the game is indexed too
+        run.push_back(PositionRecord{board.getHash(), static_cast<uint32_t>(game), ply});
+        if (run.size() >= runCapacity) {
+            ok = spill();
+        }
+    }
+    if (ok && !run.empty()) {
+        ok = spill();
+    }
+    
+    FILE* out = ok ? std::fopen(indexPath.c_str(), "wb") : nullptr;
+    if (out == nullptr) {
+        std::cout << "Cannot write " << indexPath << ".\n";
+        for (const std::string& runPath : runPaths) std::remove(runPath.c_str());
+        return 1;
+    }
+    std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+    std::vector<uint64_t> buckets(PositionIndex::BUCKET_COUNT + 1, 0);
+    std::vector<char> header(PositionIndex::HEADER_SIZE, 0);
+    std::fwrite(header.data(), 1, header.size(), out);
+    
+    // k-way merge of the sorted runs
+    std::vector<MappedFile> runs(runPaths.size());
+    typedef std::pair<PositionRecord, size_t> Head;
+    auto later = [](const Head& a, const Head& b) { return b.first < a.first; };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+    std::vector<size_t> positions(runPaths.size(), 0);
+    auto recordAt = [&](size_t r, size_t i) {
+        PositionRecord record;
+        std::memcpy(&record, runs[r].begin() + i * sizeof(PositionRecord), sizeof(PositionRecord));
+        return record;
+    };
+    for (size_t r = 0; r < runPaths.size(); ++r) {
+        if (runs[r].open(runPaths[r]) && runs[r].size() >= sizeof(PositionRecord)) {
+            heads.push(Head(recordAt(r, 0), r));
+        }
+    }
+    
+    uint64_t count = 0;
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        std::fwrite(&head.first, sizeof(PositionRecord), 1, out);
+        ++buckets[(head.first.hash >> 48) + 1];
+        ++count;
+        size_t r = head.second;
+        if (++positions[r] < runs[r].size() / sizeof(PositionRecord)) {
+            heads.push(Head(recordAt(r, positions[r]), r));
+        }
+    }
+    for (size_t b = 1; b < buckets.size(); ++b) {
+        buckets[b] += buckets[b - 1];
+    }
+    
+    std::memcpy(header.data(), "COPI", 4);
+    std::memcpy(header.data() + 8, &count, 8);
+    std::memcpy(header.data() + 16, buckets.data(), buckets.size() * 8);
+    std::fseek(out, 0, SEEK_SET);
+    std::fwrite(header.data(), 1, header.size(), out);
+    ok = std::fclose(out) == 0;
+    
+    runs.clear();
+    for (const std::string& runPath : runPaths) {
+        std::remove(runPath.c_str());
+    }
+    if (!ok) {
+        std::cout << "Cannot write " << indexPath << ".\n";
+        return 1;
+    }
+    std::cout << "Indexed " << count << " positions from " << archive.size() - corrupt << " games in "
+              << runPaths.size() << " runs, corrupt: " << corrupt << "\n";
+    return 0;
+}
+
+int queryPositionIndex(const std::string& indexPath, const std::string& fen) {
+    PositionIndex index;
+    if (!index.open(indexPath)) {
+        std::cout << "Cannot open " << indexPath << " as a position index.\n";
+        return 1;
+    }
+    ChessBoard board;
+    if (!board.loadFen(fen)) {
+        std::cout << "Invalid FEN.\n";
+        return 1;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    auto range = index.find(board.getHash());
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    
+    std::cout << (range.second - range.first) << " occurrences (" << micros << " us)\n";
+    for (const PositionRecord* record = range.first; record != range.second && record - range.first < 20; ++record) {
+        std::cout << "game " << record->game << " ply " << record->ply << "\n";
+    }
+    return 0;
+}
+
+// Win/draw/loss counts for one move from one position; also the on-disk record of a tree file
+struct OpeningEntry {
+    uint64_t hash;
+    uint16_t move;
+    uint16_t reserved;
+    uint32_t whiteWins;
+    uint32_t draws;
+    uint32_t blackWins;
+    
+    bool operator<(const OpeningEntry& other) const {
+        return hash != other.hash ? hash < other.hash : move < other.move;
+    }
+    
+    void add(const OpeningEntry& other) {
+        whiteWins += other.whiteWins;
+        draws += other.draws;
+        blackWins += other.blackWins;
+    }
+};
+
+// Open-addressing map from (position hash, move) to counts, one per builder thread
+class OpeningCounts {
+private:
+    std::vector<OpeningEntry> slots;
+    size_t used;
+    
+    static size_t slotFor(uint64_t hash, uint16_t move, size_t mask) {
+        uint64_t mixed = (hash ^ (static_cast<uint64_t>(move) * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+        return static_cast<size_t>(mixed >> 32) & mask;
+    }
+    
+    OpeningEntry& slot(uint64_t hash, uint16_t move) {
+        size_t mask = slots.size() - 1;
+        size_t i = slotFor(hash, move, mask);
+        // Slots with every count at zero are free; stored entries always have one game
+        while (slots[i].whiteWins + slots[i].draws + slots[i].blackWins != 0 &&
+               (slots[i].hash != hash || slots[i].move != move)) {
+            i = (i + 1) & mask;
+        }
+        return slots[i];
+    }
+    
+    void grow() {
+        std::vector<OpeningEntry> old(slots.size() * 2, OpeningEntry{0, 0, 0, 0, 0, 0});
+        old.swap(slots);
+        used = 0;
+        for (const OpeningEntry& entry : old) {
+            if (entry.whiteWins + entry.draws + entry.blackWins != 0) add(entry);
+        }
+    }
+    
+public:
+    OpeningCounts() : slots(1 << 16, OpeningEntry{0, 0, 0, 0, 0, 0}), used(0) {}
+    
+    void add(const OpeningEntry& entry) {
+        if ((used + 1) * 10 > slots.size() * 7) {
+            grow();
+        }
+        OpeningEntry& target = slot(entry.hash, entry.move);
+        if (target.whiteWins + target.draws + target.blackWins == 0) {
+            target = OpeningEntry{entry.hash, entry.move, 0, 0, 0, 0};
+            ++used;
+        }
+        target.add(entry);
+    }
+    
+    void merge(const OpeningCounts& other) {
+        for (const OpeningEntry& entry : other.slots) {
+            if (entry.whiteWins + entry.draws + entry.blackWins != 0) add(entry);
+        }
+    }
+    
+    std::vector<OpeningEntry> sorted() const {
+        std::vector<OpeningEntry> entries;
+        entries.reserve(used);
+        for (const OpeningEntry& entry : slots) {
+            if (entry.whiteWins + entry.draws + entry.blackWins != 0) entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+    
+    size_t size() const { return used; }
+};
+
+// Tree file: "COOT" u32 reserved u64 count, then OpeningEntry records sorted by (hash, move)
+class OpeningTree {
+private:
+    MappedFile file;
+    const OpeningEntry* entries;
+    uint64_t count;
+    
+public:
+    OpeningTree() : entries(nullptr), count(0) {}
+    
+    // Lookups binary-search the entries; merging reads them front to back
+    bool open(const std::string& path, MappedFile::Access access = MappedFile::Access::Random) {
+        if (!file.open(path, access) || file.size() < 16 || std::memcmp(file.begin(), "COOT", 4) != 0) {
+            return false;
+        }
+        std::memcpy(&count, file.begin() + 8, 8);
+        if (16 + count * sizeof(OpeningEntry) != file.size()) {
+            return false;
+        }
+        entries = reinterpret_cast<const OpeningEntry*>(file.begin() + 16);
+        return true;
+    }
+    
+    const OpeningEntry* begin() const { return entries; }
+    const OpeningEntry* end() const { return entries + count; }
+    
+    std::pair<const OpeningEntry*, const OpeningEntry*> find(uint64_t hash) const {
+        const OpeningEntry* first = std::lower_bound(begin(), end(), hash, [](const OpeningEntry& entry, uint64_t key) {
+            return entry.hash < key;
+        });
+        const OpeningEntry* last = first;
+        while (last != end() && last->hash == hash) ++last;
+        return std::make_pair(first, last);
+    }
+    
+    static bool write(const std::string& path, const std::vector<OpeningEntry>& sortedEntries) {
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        char header[16] = {'C', 'O', 'O', 'T'};
+        uint64_t total = sortedEntries.size();
+        std::memcpy(header + 8, &total, 8);
+        std::fwrite(header, 1, sizeof(header), out);
+        std::fwrite(sortedEntries.data(), sizeof(OpeningEntry), sortedEntries.size(), out);
+        return std::fclose(out) == 0;
+    }
+};
+
+void countOpeningMove(OpeningCounts& counts, const ChessBoard& board, const Move& move, GameResult result) {
+    OpeningEntry entry{board.getHash(), move.pack(), 0, 0, 0, 0};
+    if (result == GameResult::WhiteWins) entry.whiteWins = 1;
+    else if (result == GameResult::BlackWins) entry.blackWins = 1;
+    else entry.draws = 1;
+    counts.add(entry);
+}
+
+// Counts the first `maxPlies` moves of every decided game in PGN files or game archives.
+// Each thread fills its own map; the maps are merged once at the end.
+int buildOpeningTree(const std::vector<std::string>& inputs, const std::string& outputPath,
+                     unsigned threads, int maxPlies) {
+    std::vector<OpeningCounts> partial(threads);
+    uint64_t games = 0;
+    
+    for (const std::string& input : inputs) {
+        MappedFile probe;
+        if (!probe.open(input)) {
+            std::cout << "Cannot open " << input << ".\n";
+            return 1;
+        }
+        bool isArchive = probe.size() >= 4 && std::memcmp(probe.begin(), "COGB", 4) == 0;
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> counted(0);
+        std::vector<std::thread> workers;
+        GameArchive archive;
+        // Declared here because the workers capture them and are joined after the branches
+        const size_t chunkSize = 1 << 20;
+        size_t chunkCount = std::max<size_t>(1, (probe.size() + chunkSize - 1) / chunkSize);
+        
+        if (isArchive) {
+            if (!archive.open(input)) {
+                std::cout << "Cannot open " << input << " as a game archive.\n";
+                return 1;
+            }
+            const size_t block = 256;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    ChessBoard board;
+                    ChessBoard position;
+                    GameResult result = GameResult::Unknown;
+                    std::vector<Move> line;
+                    for (size_t first = next.fetch_add(block); first < archive.size(); first = next.fetch_add(block)) {
+                        for (size_t game = first; game < std::min(first + block, archive.size()); ++game) {
+                            line.clear();
+                            // The result is only known once the record has been read, so the
+                            // opening is collected first and counted afterwards; corrupt records are skipped
+                            bool valid = archive.replay(game, board, result, [&](const ChessBoard& current, const Move& move) {
+                                if (line.empty()) position = current;
+                                if (static_cast<int>(line.size()) < maxPlies) line.push_back(move);
+                            });
+                            if (!valid || result == GameResult::Unknown) continue;
+                            for (const Move& move : line) {
+                                countOpeningMove(partial[t], position, move, result);
+                                delete position.doMove(move);
+                            }
+                            ++counted;
+                        }
+                    }
+                });
+            }
+        } else {
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    PgnGame game;
+                    ChessBoard board;
+                    for (size_t chunk = next++; chunk < chunkCount; chunk = next++) {
+                        const char* first = findGameStart(probe.begin(), probe.end(), probe.begin() + std::min(probe.size(), chunk * chunkSize));
+                        const char* last = findGameStart(probe.begin(), probe.end(), probe.begin() + std::min(probe.size(), (chunk + 1) * chunkSize));
+                        PgnParser parser(first, static_cast<size_t>(std::max(first, last) - first));
+                        while (parser.next(game)) {
+                            GameResult result = parseResult(game.result);
+                            std::string_view fen = game.tag("FEN");
+                            if (result == GameResult::Unknown || !board.loadFen(fen.empty() ? START_FEN : std::string(fen))) {
+                                continue;
+                            }
+                            for (size_t ply = 0; ply < game.moves.size() && static_cast<int>(ply) < maxPlies; ++ply) {
+                                countOpeningMove(partial[t], board, game.moves[ply], result);
+                                delete board.doMove(game.moves[ply]);
+                            }
+                            ++counted;
+                        }
+                    }
+                });
+            }
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        games += counted;
+    }
+    
+    for (unsigned t = 1; t < threads; ++t) {
+        partial[0].merge(partial[t]);
+        partial[t] = OpeningCounts();
+    }
+    std::vector<OpeningEntry> entries = partial[0].sorted();
+    if (!OpeningTree::write(outputPath, entries)) {
+        std::cout << "Cannot write " << outputPath << ".\n";
+        return 1;
+    }
+    std::cout << "Games: " << games << ", position/move pairs: " << entries.size() << "\n";
+    return 0;
+}
+
+// Sums tree files that were built separately (for example on different machines)
+int mergeOpeningTrees(const std::vector<std::string>& inputs, const std::string& outputPath) {
+    std::vector<OpeningEntry> merged;
+    for (const std::string& input : inputs) {
+        OpeningTree tree;
+        if (!tree.open(input, MappedFile::Access::Sequential)) {
+            std::cout << "Cannot open " << input << " as an opening tree.\n";
+            return 1;
+        }
+        std::vector<OpeningEntry> combined;
+        combined.reserve(merged.size() + (tree.end() - tree.begin()));
+        const OpeningEntry* a = merged.data();
+        const OpeningEntry* aEnd = merged.data() + merged.size();
+        const OpeningEntry* b = tree.begin();
+        while (a != aEnd || b != tree.end()) {
+            if (b == tree.end() || (a != aEnd && *a < *b)) {
+                combined.push_back(*a++);
+            } else if (a == aEnd || *b < *a) {
+                combined.push_back(*b++);
+            } else {
+                combined.push_back(*a++);
+                combined.back().add(*b++);
+            }
+        }
+        merged.swap(combined);
+    }
+    if (!OpeningTree::write(outputPath, merged)) {
+        std::cout << "Cannot write " << outputPath << ".\n";
+        return 1;
+    }
+    std::cout << "Position/move pairs: " << merged.size() << "\n";
+    return 0;
+}
+
+int queryOpeningTree(const std::string& treePath, const std::string& fen) {
+    OpeningTree tree;
+    ChessBoard board;
+    if (!tree.open(treePath)) {
+        std::cout << "Cannot open " << treePath << " as an opening tree.\n";
+        return 1;
+    }
+    if (!board.loadFen(fen)) {
+        std::cout << "Invalid FEN.\n";
+        return 1;
+    }
+    auto range = tree.find(board.getHash());
+    for (const OpeningEntry* entry = range.first; entry != range.second; ++entry) {
+        std::cout << Move::unpack(entry->move).toString() << "  +" << entry->whiteWins << " ="
+                  << entry->draws << " -" << entry->blackWins << "\n";
+    }
+    return 0;
+}
+
+int showBookMoves(const std::string& keysPath, const std::string& bookPath, const std::string& fen) {
+    PolyglotBook book;
+    ChessBoard board;
+    if (!book.open(bookPath, keysPath)) {
+        std::cout << "Cannot open " << bookPath << " with keys from " << keysPath << ".\n";
+        return 1;
+    }
+    if (!board.loadFen(fen)) {
+        std::cout << "Invalid FEN.\n";
+        return 1;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<BookMove> moves;
+    book.probe(board, moves);
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    
+    for (const BookMove& entry : moves) {
+        std::cout << entry.move.toString() << " weight " << entry.weight << "\n";
+    }
+    std::cout << moves.size() << " book moves (" << micros << " us)\n";
+    return 0;
+}
+
+// tbgen <directory> <signature...>, e.g. "tbgen tb KQvK KRvK KRvKP"
+int generateTablebases(const std::string& directory, const std::vector<std::string>& signatures) {
+    TablebaseSet tables;
+    tables.loadDirectory(directory);
+    TablebaseGenerator generator(tables, defaultThreadCount());
+    for (const std::string& signature : signatures) {
+        if (!generator.generate(signature)) {
+            return 1;
+        }
+    }
+    
+    // Write whatever was generated, including the smaller tables pulled in along the way
+    for (const std::string& signature : signatures) {
+        std::string symbols;
+        Tablebase::parseSignature(signature, symbols);
+        std::vector<std::string> pending{Tablebase::signatureOf(symbols)};
+        while (!pending.empty()) {
+            std::string current = pending.back();
+            pending.pop_back();
+            std::string path = directory + "/" + current + ".cotb";
+            if (access(path.c_str(), F_OK) == 0) {
+                continue;
+            }
+            const Tablebase* table = tables.find(current);
+            if (table == nullptr || !table->write(path)) {
+                std::cout << "Cannot write " << path << ".\n";
+                return 1;
+            }
+            const std::string& pieces = table->getPieces();
+            for (size_t j = 0; j < pieces.size(); ++j) {
+                if (std::tolower(pieces[j]) != 'k') {
+                    pending.push_back(Tablebase::signatureOf(pieces.substr(0, j) + pieces.substr(j + 1)));
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int probeTablebases(const std::string& directory, const std::string& fen) {
+    TablebaseSet tables;
+    ChessBoard board;
+    tables.loadDirectory(directory);
+    if (!board.loadFen(fen)) {
+        std::cout << "Invalid FEN.\n";
+        return 1;
+    }
+    uint8_t value;
+    if (!tables.probe(board, value)) {
+        std::cout << "No table for this position.\n";
+        return 1;
+    }
+    if (value == 0) std::cout << "Draw\n";
+    else if (value < Tablebase::LOSS) std::cout << "Win, king captured in " << static_cast<int>(value) << " plies\n";
+    else std::cout << "Loss, king captured in " << (value - Tablebase::LOSS) << " plies\n";
+    return 0;
+}
+
+// Searches every FEN/EPD line of the input to a fixed depth, one search per worker thread,
+// and prints "bestmove <move> score <score> depth <d> nodes <n>" per line in input order.
+// Each worker owns its board copy, caches and hash table; the queues are the only shared state.
+int runBatchAnalysis(int depth, const std::string& path, unsigned threads) {
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            std::cerr << "Cannot open " << path << ".\n";
+            return 1;
+        }
+    }
+    std::istream& in = path == "-" ? std::cin : file;
+    
+    BoundedQueue<std::pair<size_t, std::string>> work(threads * 64);
+    OrderedQueue<std::string> results(threads * 64);
+    std::atomic<uint64_t> totalNodes(0);
+    auto startTime = std::chrono::steady_clock::now();
+#ifdef CHESS_STATS
+    SearchStats totalStats;
+    std::mutex statsMutex;
+#endif
+    
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            EvalCache evalCache(256);
+            TranspositionTable tt(1);
+            SearchSignals signals;
+            ChessBoard board;
+            SearchLimits limits;
+            limits.depth = depth;
+            SEARCH_STAT(SearchStats workerStats);
+            std::pair<size_t, std::string> item;
+            while (work.pop(item)) {
+                if (!board.loadFen(item.second)) {
+                    results.push(item.first, "error invalid position");
+                    continue;
+                }
+                // Fresh tables per position keep the output independent of the thread count
+                tt.clear();
+                evalCache.clear();
+                Search search(board, evalCache, tt, signals);
+                SearchInfo info = search.run(limits, [](const SearchInfo&) {});
+                totalNodes += info.nodes;
+                SEARCH_STAT(workerStats.merge(search.statistics()));
+                results.push(item.first, "bestmove " + (info.pv.empty() ? std::string("0000") : info.pv[0].toString()) +
+                                         " score " + formatScore(info.score) + " depth " + std::to_string(info.depth) +
+                                         " nodes " + std::to_string(info.nodes));
+            }
+#ifdef CHESS_STATS
+            std::lock_guard<std::mutex> lock(statsMutex);
+            totalStats.merge(workerStats);
+#endif
+        });
+    }
+    
+    std::thread writer([&] {
+        std::string line;
+        while (results.pop(line)) {
+            line += '\n';
+            std::fwrite(line.data(), 1, line.size(), stdout);
+        }
+        std::fflush(stdout);
+    });
+    
+    size_t count = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        work.push(std::make_pair(count++, line));
+    }
+    work.close();
+    results.setTotal(count);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    writer.join();
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cerr << "Positions: " << count << ", nodes: " << totalNodes << ", threads: " << threads << ", time: "
+              << seconds << " s, " << static_cast<uint64_t>(seconds > 0 ? totalNodes / seconds : 0.0) << " nps\n";
+    SEARCH_STAT(std::cerr << "Search statistics: " << totalStats.toJson() << "\n");
+    return 0;
+}
+
+struct EpdTest {
+    std::string id;
+    std::string fen;
+    std::vector<Move> bestMoves;
+    std::vector<Move> avoidMoves;
+    bool supported = true;
+    
+    bool isSolvedBy(const Move& move) const {
+        if (!bestMoves.empty() && std::find(bestMoves.begin(), bestMoves.end(), move) == bestMoves.end()) return false;
+        return std::find(avoidMoves.begin(), avoidMoves.end(), move) == avoidMoves.end();
+    }
+};
+
+// "<placement> <side> <castling> <ep> bm Qxf7+; id \"WAC.001\";" -- opcodes other than
+// bm, am and id are ignored. Suites that need castling or promotion are marked unsupported.
+bool parseEpdTest(const std::string& line, EpdTest& test) {
+    std::istringstream fields(line);
+    std::string placement, side, castling, enPassant;
+    if (!(fields >> placement >> side >> castling >> enPassant)) {
+        return false;
+    }
+    test.fen = placement + " " + side;
+    ChessBoard board;
+    if (!board.loadFen(test.fen)) {
+        return false;
+    }
+    
+    std::string rest;
+    std::getline(fields, rest);
+    size_t start = 0;
+    while (start < rest.size()) {
+        size_t end = rest.find(';', start);
+        if (end == std::string::npos) end = rest.size();
+        std::istringstream operation(rest.substr(start, end - start));
+        std::string opcode, operand;
+        operation >> opcode;
+        if (opcode == "id") {
+            std::getline(operation >> std::ws, operand);
+            test.id = operand.size() >= 2 && operand.front() == '"' ? operand.substr(1, operand.size() - 2) : operand;
+        } else if (opcode == "bm" || opcode == "am") {
+            std::vector<Move>& moves = opcode == "bm" ? test.bestMoves : test.avoidMoves;
+            while (operation >> operand) {
+                Move move;
+                if (parseSan(board, operand, move)) moves.push_back(move);
+                else test.supported = false;
+            }
+        }
+        start = end + 1;
+    }
+    if (test.bestMoves.empty() && test.avoidMoves.empty()) {
+        test.supported = false;
+    }
+    return true;
+}
+
+struct EpdOutcome {
+    bool solved = false;
+    int64_t solvedAt = -1;      // ms at which the final, correct move was first chosen
+    uint64_t nodes = 0;
+    Move played{0, 0, 0, 0};
+};
+
+// epdtest <file> <time|nodes> <limit> [threads]: searches every supported position in
+// parallel and reports solved count, time-to-solution distribution and nodes/sec
+int runEpdSuite(const std::string& path, bool nodeLimit, int64_t limit, unsigned threads) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "Cannot open " << path << ".\n";
+        return 1;
+    }
+    std::vector<EpdTest> tests;
+    std::string line;
+    while (std::getline(in, line)) {
+        EpdTest test;
+        if (!line.empty() && parseEpdTest(line, test)) {
+            if (test.id.empty()) test.id = "#" + std::to_string(tests.size() + 1);
+            tests.push_back(test);
+        }
+    }
+    
+    std::vector<EpdOutcome> outcomes(tests.size());
+    std::atomic<size_t> next(0);
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            EvalCache evalCache(256);
+            TranspositionTable tt(16);
+            SearchSignals signals;
+            ChessBoard board;
+            SearchLimits limits;
+            if (nodeLimit) limits.nodes = static_cast<uint64_t>(limit);
+            else limits.moveTime = limit;
+            limits.moveOverhead = 0;
+            
+            for (size_t i = next++; i < tests.size(); i = next++) {
+                const EpdTest& test = tests[i];
+                if (!test.supported || !board.loadFen(test.fen)) continue;
+                tt.clear();
+                evalCache.clear();
+                
+                EpdOutcome& outcome = outcomes[i];
+                Search search(board, evalCache, tt, signals);
+                SearchInfo info = search.run(limits, [&](const SearchInfo& iteration) {
+                    bool good = !iteration.pv.empty() && test.isSolvedBy(iteration.pv[0]);
+                    if (!good) outcome.solvedAt = -1;
+                    else if (outcome.solvedAt < 0) outcome.solvedAt = iteration.elapsed;
+                });
+                outcome.nodes = info.nodes;
+                outcome.played = info.pv.empty() ? Move{0, 0, 0, 0} : info.pv[0];
+                outcome.solved = !info.pv.empty() && test.isSolvedBy(info.pv[0]);
+                if (outcome.solved && outcome.solvedAt < 0) outcome.solvedAt = info.elapsed;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    
+    static const int64_t bounds[] = {10, 100, 500, 1000, 5000, 10000};
+    const size_t bucketCount = sizeof(bounds) / sizeof(bounds[0]) + 1;
+    std::vector<size_t> buckets(bucketCount, 0);
+    size_t solved = 0, unsupported = 0;
+    uint64_t nodes = 0;
+    for (size_t i = 0; i < tests.size(); ++i) {
+        nodes += outcomes[i].nodes;
+        if (!tests[i].supported) {
+            ++unsupported;
+        } else if (outcomes[i].solved) {
+            ++solved;
+            size_t b = 0;
+            while (b < bucketCount - 1 && outcomes[i].solvedAt >= bounds[b]) ++b;
+            ++buckets[b];
+        } else {
+            std::cout << "failed " << tests[i].id << " played " << outcomes[i].played.toString() << "\n";
+        }
+    }
+    
+    std::cout << "Solved " << solved << " of " << tests.size() - unsupported << " (" << unsupported
+              << " skipped: castling, promotion or no bm/am)\n";
+    std::cout << "Time to solution:";
+    for (size_t b = 0; b < bucketCount; ++b) {
+        std::cout << (b < bucketCount - 1 ? " <" + std::to_string(bounds[b]) + "ms: " : " more: ") << buckets[b];
+    }
+    std::cout << "\nNodes: " << nodes << ", time: " << seconds << " s, "
+              << static_cast<uint64_t>(seconds > 0 ? nodes / seconds : 0.0) << " nps on " << threads << " threads\n";
+    return 0;
+}
+
+// Fixed workload for comparing builds: same positions, same depth, fresh tables for every
+// position and one thread, so the node total is a signature of the search's behavior
+const char* const BENCH_POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w",
+    "rnbqkb1r/pp3ppp/4pn2/2pp4/2PP4/2N1PN2/PP3PPP/R1BQKB1R b",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w",
+    "2r3k1/pp3ppp/2n1b3/3p4/3P4/2N1B3/PP3PPP/2R3K1 b",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b",
+    "8/8/8/4k3/8/8/8/KR6 w",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w",
+    "r3k2r/8/8/8/8/8/8/R3K2R b",
+};
+
+int runBench(int depth) {
+    EvalCache evalCache(256);
+    TranspositionTable tt(16);
+    SearchSignals signals;
+    ChessBoard board;
+    SearchLimits limits;
+    limits.depth = depth;
+    
+    uint64_t totalNodes = 0;
+    int64_t totalTime = 0;
+    SEARCH_STAT(SearchStats totalStats);
+    size_t count = sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]);
+    for (size_t i = 0; i < count; ++i) {
+        board.loadFen(BENCH_POSITIONS[i]);
+        tt.clear();
+        evalCache.clear();
+        Search search(board, evalCache, tt, signals);
+        SearchInfo info = search.run(limits, [](const SearchInfo&) {});
+        totalNodes += info.nodes;
+        totalTime += info.elapsed;
+        SEARCH_STAT(totalStats.merge(search.statistics()));
+        std::cout << "Position " << i + 1 << "/" << count << ": " << info.nodes << " nodes, bestmove "
+                  << (info.pv.empty() ? std::string("0000") : info.pv[0].toString()) << "\n";
+    }
+    
+    std::cout << "===========================\n";
+    std::cout << "Total time (ms) : " << totalTime << "\n";
+    std::cout << "Nodes searched  : " << totalNodes << "\n";
+    std::cout << "Nodes/second    : " << (totalTime > 0 ? totalNodes * 1000 / totalTime : totalNodes) << "\n";
+    SEARCH_STAT(std::cout << "Search statistics: " << totalStats.toJson() << "\n");
+    return 0;
+}
+
+// Renders positions back to back into one 64 KB buffer, written out whenever the next board
+// might not fit, so dumping many positions costs one write per buffer instead of per token
+class RenderBatch {
+private:
+    char buffer[1 << 16];
+    size_t used;
+    FILE* out;
+    RenderStyle style;
+    
+public:
+    RenderBatch(FILE* file, RenderStyle renderStyle) : used(0), out(file), style(renderStyle) {}
+    RenderBatch(const RenderBatch&) = delete;
+    RenderBatch& operator=(const RenderBatch&) = delete;
+    
+    ~RenderBatch() {
+        flush();
+    }
+    
+    void add(const ChessBoard& board) {
+        if (sizeof(buffer) - used < ChessBoard::RENDER_BUFFER_SIZE) {
+            flush();
+        }
+        used += board.render(buffer + used, sizeof(buffer) - used, style);
+    }
+    
+    void flush() {
+        if (used > 0) {
+            std::fwrite(buffer, 1, used, out);
+            used = 0;
+        }
+        std::fflush(out);
+    }
+};
+
+// render [file|-] [text|unicode]: prints every FEN line of the input as a board
+int renderPositions(const std::string& path, RenderStyle style) {
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            std::cerr << "Cannot open " << path << ".\n";
+            return 1;
+        }
+    }
+    std::istream& in = path == "-" ? std::cin : file;
+    
+    ChessBoard board;
+    RenderBatch batch(stdout, style);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#' && board.loadFen(line)) {
+            batch.add(board);
+        }
+    }
+    return 0;
+}
+
+// selftest: behaviour that needs real time to observe. Returns non-zero if a check fails.
+int runSelfTest() {
+    int failures = 0;
+    
+    // A ponder search turned into a real one by ponderhit must obey the clock it was given
+    {
+        EvalCache evalCache(256);
+        TranspositionTable tt(16);
+        SearchSignals signals;
+        ChessBoard board;
+        SearchLimits limits;
+        limits.ponder = true;
+        limits.whiteTime = limits.blackTime = 2000;
+        signals.ponder = true;
+        
+        TimeManager reference;
+        SearchLimits timed = limits;
+        timed.ponder = false;
+        reference.start(timed, board.isWhiteToMove());
+        
+        // Sends ponderhit after 200 ms, and stops the search if it is still running after 5 s
+        Search search(board, evalCache, tt, signals);
+        std::atomic<bool> finished(false);
+        std::thread ponderhit([&signals, &finished] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            signals.ponder = false;
+            for (int waited = 0; waited < 5000 && !finished; waited += 10) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            signals.stop = true;
+        });
+        auto start = std::chrono::steady_clock::now();
+        search.run(limits, [](const SearchInfo&) {});
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        finished = true;
+        ponderhit.join();
+        
+        // 200 ms of pondering, then at most the hard limit, with some slack for a busy machine
+        bool passed = reference.isTimed() && elapsed <= 200 + reference.getHardLimit() + 100;
+        std::cout << (passed ? "ok     " : "FAILED ") << "ponderhit returns within the hard limit (" << elapsed
+                  << " ms, limit " << reference.getHardLimit() << " ms after ponderhit)\n";
+        failures += passed ? 0 : 1;
+    }
+    
+    return failures == 0 ? 0 : 1;
+}
+
+// Keeps benchmarked results alive so the optimizer cannot drop the work
+volatile uint64_t benchmarkSink = 0;
+
+struct MicroResult {
+    std::string name;
+    uint64_t operations;        // per repetition
+    double medianNs;
+    double minNs;
+    double maxNs;
+};
+
+// Calibrates each body to roughly 10 ms per repetition, runs warm-up repetitions, then
+// records per-operation time over the measured repetitions
+class MicroBenchmark {
+private:
+    std::vector<MicroResult> results;
+    int warmups;
+    int repetitions;
+    
+    template <typename Body>
+    static double timeRepetition(uint64_t operations, Body& body) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < operations; ++i) body(i);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+public:
+    MicroBenchmark(int warmupCount, int repetitionCount) : warmups(warmupCount), repetitions(repetitionCount) {}
+    
+    template <typename Body>
+    void run(const std::string& name, Body body) {
+        uint64_t operations = 1;
+        while (operations < (1ULL << 30) && timeRepetition(operations, body) < 1e7) operations *= 2;
+        for (int i = 0; i < warmups; ++i) timeRepetition(operations, body);
+        
+        std::vector<double> samples;
+        for (int i = 0; i < repetitions; ++i) samples.push_back(timeRepetition(operations, body) / operations);
+        std::sort(samples.begin(), samples.end());
+        results.push_back(MicroResult{name, operations, samples[samples.size() / 2], samples.front(), samples.back()});
+    }
+    
+    void report(const std::string& format) const {
+        char line[256];
+        if (format == "json") {
+            std::cout << "[\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const MicroResult& r = results[i];
+                std::snprintf(line, sizeof(line),
+                              "  {\"name\": \"%s\", \"operations\": %llu, \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                              r.name.c_str(), static_cast<unsigned long long>(r.operations), r.medianNs, r.minNs, r.maxNs,
+                              i + 1 < results.size() ? "," : "");
+                std::cout << line;
+            }
+            std::cout << "]\n";
+        } else if (format == "csv") {
+            std::cout << "name,operations,median_ns,min_ns,max_ns\n";
+            for (const MicroResult& r : results) {
+                std::snprintf(line, sizeof(line), "%s,%llu,%.3f,%.3f,%.3f\n", r.name.c_str(),
+                              static_cast<unsigned long long>(r.operations), r.medianNs, r.minNs, r.maxNs);
+                std::cout << line;
+            }
+        } else {
+            for (const MicroResult& r : results) {
+                std::snprintf(line, sizeof(line), "%-28s %12.2f ns/op  (min %.2f, max %.2f)\n", r.name.c_str(),
+                              r.medianNs, r.minNs, r.maxNs);
+                std::cout << line;
+            }
+        }
+    }
+};
+
+// microbench [text|json|csv]: timings of the board primitives in isolation
+int runMicroBenchmarks(const std::string& format) {
+    const std::string middlegame = "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2NBPN2/PP3PPP/R2QK2R w";
+    MicroBenchmark bench(3, 15);
+    
+    // A bare grid for calling piece rules directly, as ChessBoard does
+    std::vector<std::unique_ptr<ChessPiece>> owned;
+    std::vector<std::vector<ChessPiece*>> grid(8, std::vector<ChessPiece*>(8, nullptr));
+    ChessBoard position;
+    position.loadFen(middlegame);
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            if (position.getPiece(x, y) != nullptr) {
+                owned.emplace_back(createPiece(position.getPiece(x, y)->getSymbol()));
+                grid[y][x] = owned.back().get();
+            }
+        }
+    }
+    
+    bench.run("isPathClear", [&](uint64_t i) {
+        benchmarkSink += grid[7][0]->isPathClear(0, 7, static_cast<int>(i & 7), 0, grid);
+    });
+    
+    // Every piece type from a square it occupies in the middlegame, against all 64 targets
+    const std::pair<const char*, int> pieceSquares[] = {
+        {"Pawn::isValidMove", 6 * 8 + 0}, {"Rook::isValidMove", 7 * 8 + 0}, {"Knight::isValidMove", 5 * 8 + 2},
+        {"Bishop::isValidMove", 5 * 8 + 3}, {"Queen::isValidMove", 7 * 8 + 3}, {"King::isValidMove", 7 * 8 + 4},
+    };
+    for (const auto& entry : pieceSquares) {
+        int fromX = entry.second & 7, fromY = entry.second >> 3;
+        const ChessPiece* piece = grid[fromY][fromX];
+        bench.run(entry.first, [&, piece, fromX, fromY](uint64_t i) {
+            benchmarkSink += piece->isValidMove(fromX, fromY, static_cast<int>(i & 7), static_cast<int>((i >> 3) & 7), grid);
+        });
+    }
+    bench.run("isValidPieceMove (Queen)", [&](uint64_t i) {
+        benchmarkSink += isValidPieceMove(grid[7][3]->getTypeIndex(), 3, 7, static_cast<int>(i & 7),
+                                          static_cast<int>((i >> 3) & 7), grid);
+    });
+    
+    ChessBoard game;
+    const char* const shuffle[4][2] = {{"g1", "f3"}, {"g8", "f6"}, {"f3", "g1"}, {"f6", "g8"}};
+    // Calibration restarts the index, so the knight shuffle keeps its own step
+    unsigned step = 0;
+    bench.run("ChessBoard::makeMove", [&](uint64_t) {
+        benchmarkSink += game.makeMove(shuffle[step & 3][0], shuffle[step & 3][1]);
+        ++step;
+    });
+    bench.run("ChessBoard::isGameOver", [&](uint64_t) {
+        benchmarkSink += game.isGameOver();
+    });
+    bench.run("ChessBoard::ChessBoard", [&](uint64_t) {
+        ChessBoard fresh;
+        benchmarkSink += fresh.getHash();
+    });
+    bench.run("ChessBoard::loadFen", [&](uint64_t) {
+        benchmarkSink += position.loadFen(middlegame);
+    });
+    
+    std::vector<Move> moves;
+    bench.run("ChessBoard::generateMoves", [&](uint64_t) {
+        position.generateMoves(moves);
+        benchmarkSink += moves.size();
+    });
+    bench.run("ChessBoard::doMove+undoMove", [&](uint64_t i) {
+        const Move& move = moves[i % moves.size()];
+        ChessPiece* captured = position.doMove(move);
+        position.undoMove(move, captured);
+        benchmarkSink += position.getHash();
+    });
+    bench.run("ChessBoard::evaluate", [&](uint64_t) {
+        benchmarkSink += static_cast<uint64_t>(position.evaluate());
+    });
+    char rendered[ChessBoard::RENDER_BUFFER_SIZE];
+    bench.run("ChessBoard::render", [&](uint64_t) {
+        benchmarkSink += position.render(rendered, sizeof(rendered));
+    });
+    
+    bench.report(format);
+    return 0;
+}
+
+// One engine of a match or data generation run:
+// "cmd=./chess_new,name=new,tc=10+0.1,depth=5,nodes=0,movetime=0,hash=16,option.Threads=1".
+// cmd and option.* only apply to match, which runs the command as a UCI engine; tc is
+// base seconds plus increment seconds per move, kept by the match runner.
+struct EngineConfig {
+    std::string name;
+    std::string command;
+    std::vector<std::pair<std::string, std::string>> options;
+    SearchLimits limits;
+    size_t hashMb = 16;
+    int64_t baseTime = 0;       // milliseconds, 0 means no clock
+    int64_t increment = 0;
+    
+    bool parse(const std::string& spec, const std::string& defaultName) {
+        name = defaultName;
+        command.clear();
+        options.clear();
+        limits = SearchLimits();
+        limits.moveOverhead = 0;
+        baseTime = increment = 0;
+        std::istringstream iss(spec);
+        std::string field;
+        while (std::getline(iss, field, ',')) {
+            size_t equals = field.find('=');
+            if (equals == std::string::npos) return false;
+            std::string key = field.substr(0, equals), value = field.substr(equals + 1);
+            if (key == "name") name = value;
+            else if (key == "cmd") command = value;
+            else if (key.compare(0, 7, "option.") == 0 && key.size() > 7) options.emplace_back(key.substr(7), value);
+            else if (key == "tc") {
+                size_t plus = value.find('+');
+                baseTime = static_cast<int64_t>(std::atof(value.c_str()) * 1000.0);
+                increment = plus == std::string::npos ? 0 : static_cast<int64_t>(std::atof(value.c_str() + plus + 1) * 1000.0);
+            }
+            else if (key == "depth") limits.depth = std::atoi(value.c_str());
+            else if (key == "nodes") limits.nodes = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "movetime") limits.moveTime = std::atoll(value.c_str());
+            else if (key == "hash") hashMb = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+            else return false;
+        }
+        // An unlimited search would never return a move
+        return limits.depth > 0 || limits.nodes > 0 || limits.moveTime > 0 || baseTime > 0;
+    }
+};
+
+// A UCI engine running as a child process, talking over a pipe pair. Lines are read with a
+// deadline so a hung or crashed engine costs a game rather than the whole match.
+class UciProcess {
+private:
+    pid_t pid = -1;
+    int toEngine = -1;
+    int fromEngine = -1;
+    std::string buffer;
+    
+public:
+    UciProcess() = default;
+    UciProcess(const UciProcess&) = delete;
+    UciProcess& operator=(const UciProcess&) = delete;
+    ~UciProcess() { stop(); }
+    
+    bool isRunning() const { return pid > 0; }
+    
+    // Runs the command (split on spaces, looked up in PATH) and waits for "uciok"
+    bool start(const std::string& command, int64_t timeoutMs) {
+        stop();
+        std::vector<std::string> args;
+        std::istringstream iss(command);
+        std::string arg;
+        while (iss >> arg) args.push_back(arg);
+        if (args.empty()) {
+            return false;
+        }
+        std::vector<char*> argv;
+        for (std::string& text : args) argv.push_back(&text[0]);
+        argv.push_back(nullptr);
+        
+        // Close-on-exec so engines started by other game threads do not inherit these ends
+        int input[2], output[2];
+        if (pipe2(input, O_CLOEXEC) != 0) {
+            return false;
+        }
+        if (pipe2(output, O_CLOEXEC) != 0) {
+            close(input[0]);
+            close(input[1]);
+            return false;
+        }
+        pid = fork();
+        if (pid == 0) {
+            dup2(input[0], STDIN_FILENO);
+            dup2(output[1], STDOUT_FILENO);
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        close(input[0]);
+        close(output[1]);
+        toEngine = input[1];
+        fromEngine = output[0];
+        if (pid < 0) {
+            stop();
+            return false;
+        }
+        return send("uci") && waitFor("uciok", timeoutMs);
+    }
+    
+    void stop() {
+        if (pid > 0) {
+            send("quit");
+            close(toEngine);
+            toEngine = -1;
+            // Give the engine a moment to exit on its own
+            int status = 0;
+            for (int i = 0; i < 100 && waitpid(pid, &status, WNOHANG) == 0; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            if (waitpid(pid, &status, WNOHANG) == 0) {
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+            }
+        }
+        if (toEngine >= 0) close(toEngine);
+        if (fromEngine >= 0) close(fromEngine);
+        pid = -1;
+        toEngine = fromEngine = -1;
+        buffer.clear();
+    }
+    
+    bool send(const std::string& line) {
+        std::string text = line + "\n";
+        size_t written = 0;
+        while (written < text.size()) {
+            ssize_t count = write(toEngine, text.data() + written, text.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            written += static_cast<size_t>(count);
+        }
+        return true;
+    }
+    
+    // False on end of file, a read error or when the deadline passes
+    bool readLine(std::string& line, std::chrono::steady_clock::time_point deadline) {
+        while (true) {
+            size_t newline = buffer.find('\n');
+            if (newline != std::string::npos) {
+                line.assign(buffer, 0, newline);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                buffer.erase(0, newline + 1);
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+            pollfd ready = {fromEngine, POLLIN, 0};
+            int polled = poll(&ready, 1, static_cast<int>(std::min<int64_t>(remaining, INT_MAX)));
+            if (polled == 0 || (polled < 0 && errno == EINTR)) continue;
+            if (polled < 0) return false;
+            char chunk[4096];
+            ssize_t count = read(fromEngine, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+    }
+    
+    // Skips lines until one equals the token
+    bool waitFor(const std::string& token, int64_t timeoutMs) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        std::string line;
+        while (readLine(line, deadline)) {
+            if (line == token) return true;
+        }
+        return false;
+    }
+};
+
+// Sequential probability ratio test on the match score with the usual normal approximation:
+// stop once the log-likelihood ratio of elo1 over elo0 leaves [lower, upper]
+class Sprt {
+private:
+    double score0, score1, lower, upper;
+    
+    static double expectedScore(double elo) { return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0)); }
+    
+public:
+    Sprt(double elo0, double elo1, double alpha, double beta)
+        : score0(expectedScore(elo0)), score1(expectedScore(elo1)),
+          lower(std::log(beta / (1.0 - alpha))), upper(std::log((1.0 - beta) / alpha)) {}
+    
+    double llr(uint64_t wins, uint64_t draws, uint64_t losses) const {
+        double games = static_cast<double>(wins + draws + losses);
+        if (games == 0) {
+            return 0.0;
+        }
+        double score = (wins + 0.5 * draws) / games;
+        double variance = (wins * (1.0 - score) * (1.0 - score) + draws * (0.5 - score) * (0.5 - score) +
+                           losses * score * score) / games;
+        if (variance <= 0.0) {
+            return 0.0;     // identical results so far say nothing about the spread
+        }
+        return games * (score1 - score0) * (2.0 * score - score0 - score1) / (2.0 * variance);
+    }
+    
+    double lowerBound() const { return lower; }
+    double upperBound() const { return upper; }
+};
+
+enum class MatchOutcome { FirstWins, SecondWins, Draw, Abandoned };
+
+// Plays one game between two engine processes from a FEN, sending the opening plus the moves so
+// far before every "go". Ends on king capture, no legal moves, an illegal move, a crash, time
+// forfeit, threefold repetition, the ply limit, or adjudication: both engines agreeing on a winner by
+// at least RESIGN_SCORE for four plies running, or a near-zero score for twenty plies after ply 80.
+// An engine that misbehaved is stopped so the caller restarts it before the next game.
+MatchOutcome playMatchGame(const std::string& fen, const EngineConfig* configs[2], UciProcess* engines[2],
+                           bool firstIsWhite, const std::atomic<bool>& cancelled, std::string& reason) {
+    static const int MAX_GAME_PLIES = 400;
+    static const int RESIGN_SCORE = 800;
+    static const int64_t READY_TIMEOUT = 10000;
+    static const int64_t MOVE_TIMEOUT = 60000;  // fixed depth or node searches
+    static const int64_t TIME_MARGIN = 50;      // clock overrun tolerated for pipe latency
+    
+    ChessBoard board;
+    if (!board.loadFen(fen)) {
+        reason = "invalid opening";
+        return MatchOutcome::Abandoned;
+    }
+    std::string position = "position fen " + board.toFen() + " moves";
+    for (int engine = 0; engine < 2; ++engine) {
+        if (!engines[engine]->send("ucinewgame") || !engines[engine]->send("isready") ||
+            !engines[engine]->waitFor("readyok", READY_TIMEOUT)) {
+            engines[engine]->stop();
+            reason = configs[engine]->name + " not ready";
+            return MatchOutcome::Abandoned;
+        }
+    }
+    int64_t clocks[2] = {configs[0]->baseTime, configs[1]->baseTime};
+    std::vector<uint64_t> history(1, board.getHash());
+    int resignPlies = 0, drawPlies = 0;
+    int lastWhiteScore = 0;
+    
+    for (int ply = 0; ply < MAX_GAME_PLIES; ++ply) {
+        if (cancelled) {
+            reason = "cancelled";
+            return MatchOutcome::Abandoned;
+        }
+        int engine = board.isWhiteToMove() == firstIsWhite ? 0 : 1;
+        MatchOutcome loss = engine == 0 ? MatchOutcome::SecondWins : MatchOutcome::FirstWins;
+        const EngineConfig& config = *configs[engine];
+        std::string go = "go";
+        if (config.baseTime > 0) {
+            int white = firstIsWhite ? 0 : 1;
+            go += " wtime " + std::to_string(clocks[white]) + " btime " + std::to_string(clocks[1 - white]) +
+                  " winc " + std::to_string(configs[white]->increment) + " binc " +
+                  std::to_string(configs[1 - white]->increment);
+        }
+        if (config.limits.depth > 0) go += " depth " + std::to_string(config.limits.depth);
+        if (config.limits.nodes > 0) go += " nodes " + std::to_string(config.limits.nodes);
+        if (config.limits.moveTime > 0) go += " movetime " + std::to_string(config.limits.moveTime);
+        
+        auto started = std::chrono::steady_clock::now();
+        auto deadline = started + std::chrono::milliseconds(config.baseTime > 0 ? clocks[engine] + TIME_MARGIN : MOVE_TIMEOUT);
+        UciProcess& process = *engines[engine];
+        if (!process.send(position) || !process.send(go)) {
+            process.stop();
+            reason = config.name + " disconnects";
+            return loss;
+        }
+        
+        // Scores come from the last "info ... score" line of the first principal variation
+        int score = 0;
+        std::string line, bestMove;
+        while (bestMove.empty() && process.readLine(line, deadline)) {
+            TokenReader tokens(line);
+            std::string_view command = tokens.next();
+            if (command == "bestmove") {
+                bestMove = std::string(tokens.next());
+            } else if (command == "info") {
+                for (std::string_view token = tokens.next(); !token.empty(); token = tokens.next()) {
+                    if (token == "string" || (token == "multipv" && tokens.nextInt() != 1)) break;
+                    if (token != "score") continue;
+                    std::string_view kind = tokens.next();
+                    int64_t value = tokens.nextInt();
+                    if (kind == "cp") score = static_cast<int>(value);
+                    else if (kind == "mate") score = value > 0 ? MATE_SCORE - static_cast<int>(value) : -MATE_SCORE - static_cast<int>(value);
+                }
+            }
+        }
+        auto finished = std::chrono::steady_clock::now();
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(finished - started).count();
+        if (bestMove.empty()) {
+            bool timedOut = finished >= deadline;
+            process.stop();
+            reason = config.name + (timedOut ? (config.baseTime > 0 ? " loses on time" : " stalls") : " disconnects");
+            return loss;
+        }
+        if (config.baseTime > 0) {
+            clocks[engine] -= elapsed;
+            if (clocks[engine] < -TIME_MARGIN) {
+                reason = config.name + " loses on time";
+                return loss;
+            }
+            clocks[engine] = std::max<int64_t>(clocks[engine], 0) + config.increment;
+        }
+        if (bestMove == "0000" || bestMove == "(none)") {
+            reason = "no legal moves";
+            return MatchOutcome::Draw;
+        }
+        Move move;
+        if (!Move::parse(bestMove, move) || !board.isLegalMove(move)) {
+            reason = config.name + " plays illegal move " + bestMove;
+            return loss;
+        }
+        
+        // Engines report from the mover's side; from white's side both engines agree on the
+        // winner only while the sign stays the same from ply to ply
+        int whiteScore = board.isWhiteToMove() ? score : -score;
+        bool decisive = std::abs(whiteScore) >= RESIGN_SCORE;
+        bool sameWinner = resignPlies > 0 && (whiteScore > 0) == (lastWhiteScore > 0);
+        resignPlies = decisive ? (sameWinner ? resignPlies + 1 : 1) : 0;
+        lastWhiteScore = whiteScore;
+        drawPlies = ply >= 80 && std::abs(whiteScore) <= 10 ? drawPlies + 1 : 0;
+        if (resignPlies >= 4) {
+            reason = "adjudicated";
+            bool whiteWins = whiteScore > 0;
+            return whiteWins == firstIsWhite ? MatchOutcome::FirstWins : MatchOutcome::SecondWins;
+        }
+        if (drawPlies >= 20) {
+            reason = "adjudicated draw";
+            return MatchOutcome::Draw;
+        }
+        
+        ChessPiece* captured = board.doMove(move);
+        bool kingTaken = isKing(captured);
+        delete captured;
+        if (kingTaken) {
+            reason = "king captured";
+            return engine == 0 ? MatchOutcome::FirstWins : MatchOutcome::SecondWins;
+        }
+        position += " " + move.toString();
+        history.push_back(board.getHash());
+        if (std::count(history.begin(), history.end(), board.getHash()) >= 3) {
+            reason = "repetition";
+            return MatchOutcome::Draw;
+        }
+    }
+    reason = "ply limit";
+    return MatchOutcome::Draw;
+}
+
+// match <openings> <first> <second> [max games] [threads] [elo0] [elo1]: each opening is played
+// twice with colours swapped until SPRT(elo0, elo1) at alpha = beta = 0.05 accepts a hypothesis
+// or the game limit is reached. Results are from the first engine's point of view. Every game
+// thread runs its own pair of engine processes for the whole match.
+int runMatch(const std::string& openingsPath, const EngineConfig& first, const EngineConfig& second,
+             uint64_t maxGames, unsigned threads, double elo0, double elo1) {
+    std::ifstream in(openingsPath);
+    if (!in) {
+        std::cout << "Cannot open " << openingsPath << ".\n";
+        return 1;
+    }
+    std::vector<std::string> openings;
+    std::string line;
+    ChessBoard probe;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#' && probe.loadFen(line)) openings.push_back(line);
+    }
+    if (openings.empty()) {
+        std::cout << "No openings in " << openingsPath << ".\n";
+        return 1;
+    }
+    
+    // A dead engine must cost a game, not the whole match
+    std::signal(SIGPIPE, SIG_IGN);
+    
+    static const int64_t START_TIMEOUT = 10000;
+    Sprt sprt(elo0, elo1, 0.05, 0.05);
+    std::mutex resultMutex;
+    uint64_t wins = 0, draws = 0, losses = 0;
+    std::atomic<uint64_t> nextGame(0);
+    std::atomic<bool> finished(false);
+    std::atomic<bool> failed(false);
+    
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            const EngineConfig* configs[2] = {&first, &second};
+            UciProcess processes[2];
+            UciProcess* engines[2] = {&processes[0], &processes[1]};
+            for (uint64_t game = nextGame++; game < maxGames && !finished; game = nextGame++) {
+                for (int engine = 0; engine < 2; ++engine) {
+                    if (processes[engine].isRunning()) continue;
+                    bool started = processes[engine].start(configs[engine]->command, START_TIMEOUT);
+                    for (const auto& option : configs[engine]->options) {
+                        started = started && processes[engine].send("setoption name " + option.first + " value " + option.second);
+                    }
+                    started = started && processes[engine].send("setoption name Hash value " + std::to_string(configs[engine]->hashMb));
+                    if (!started) {
+                        std::lock_guard<std::mutex> lock(resultMutex);
+                        if (!finished) std::cout << "Cannot start " << configs[engine]->command << ".\n";
+                        failed = finished = true;
+                        return;
+                    }
+                }
+                
+                const std::string& opening = openings[(game / 2) % openings.size()];
+                bool firstIsWhite = game % 2 == 0;
+                std::string reason;
+                MatchOutcome outcome = playMatchGame(opening, configs, engines, firstIsWhite, finished, reason);
+                if (outcome == MatchOutcome::Abandoned) {
+                    continue;
+                }
+                
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if (finished) {
+                    continue;
+                }
+                if (outcome == MatchOutcome::FirstWins) ++wins;
+                else if (outcome == MatchOutcome::SecondWins) ++losses;
+                else ++draws;
+                double llr = sprt.llr(wins, draws, losses);
+                char text[64];
+                std::snprintf(text, sizeof(text), "%.2f (%.2f, %.2f)", llr, sprt.lowerBound(), sprt.upperBound());
+                std::cout << "Game " << game + 1 << " " << (firstIsWhite ? first.name + " vs " + second.name
+                                                                         : second.name + " vs " + first.name)
+                          << ": " << (outcome == MatchOutcome::Draw ? "1/2-1/2"
+                                      : (outcome == MatchOutcome::FirstWins) == firstIsWhite ? "1-0" : "0-1")
+                          << " {" << reason << "}  score " << wins << "-" << losses << "-" << draws << "  LLR " << text
+                          << "\n";
+                if (llr <= sprt.lowerBound() || llr >= sprt.upperBound()) {
+                    finished = true;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (failed) {
+        return 1;
+    }
+    
+    uint64_t games = wins + draws + losses;
+    double score = games > 0 ? (wins + 0.5 * draws) / games : 0.5;
+    double llr = sprt.llr(wins, draws, losses);
+    char text[160];
+    std::snprintf(text, sizeof(text), "%.1f%%", 100.0 * score);
+    std::cout << "Score of " << first.name << " vs " << second.name << ": " << wins << " - " << losses << " - " << draws
+              << " [" << text << "] " << games << "\n";
+    if (score > 0.0 && score < 1.0) {
+        std::snprintf(text, sizeof(text), "Elo difference: %.1f", -400.0 * std::log10(1.0 / score - 1.0));
+        std::cout << text << "\n";
+    }
+    std::snprintf(text, sizeof(text), "SPRT elo0=%.1f elo1=%.1f: LLR %.2f (%.2f, %.2f) - ", elo0, elo1, llr,
+                  sprt.lowerBound(), sprt.upperBound());
+    std::cout << text << (llr >= sprt.upperBound() ? "H1 accepted" : llr <= sprt.lowerBound() ? "H0 accepted" : "inconclusive")
+              << "\n";
+    return 0;
+}
+
+// Training data for evaluator tuning, 32 bytes per position after an 8-byte "COTD" u16 version
+// u16 record size header:
+//   u64 occupancy (bit y * 8 + x, y = 0 is rank 8), 16 bytes of 4-bit piece codes in occupancy
+//   order (index in "PNBRQKpnbrqk"), i16 search score and i8 game result (1, 0, -1) from the
+//   side to move, u8 flags (1 = black to move), u16 ply, u16 reserved
+static const size_t TRAINING_RECORD_SIZE = 32;
+
+void encodeTrainingRecord(const ChessBoard& board, int score, int result, int ply, std::string& out) {
+    uint64_t occupancy = 0;
+    unsigned char codes[16] = {};
+    int count = 0;
+    for (int square = 0; square < 64; ++square) {
+        uint8_t code = board.pieceAt(square);
+        if (code != 0 && count < 32) {
+            occupancy |= 1ULL << square;
+            codes[count / 2] |= static_cast<unsigned char>((code - 1) << (4 * (count & 1)));
+            ++count;
+        }
+    }
+    putLittleEndian(out, occupancy, 8);
+    out.append(reinterpret_cast<const char*>(codes), sizeof(codes));
+    putLittleEndian(out, static_cast<uint16_t>(static_cast<int16_t>(score)), 2);
+    out += static_cast<char>(static_cast<int8_t>(result));
+    out += static_cast<char>(board.isWhiteToMove() ? 0 : 1);
+    putLittleEndian(out, static_cast<uint64_t>(ply), 2);
+    putLittleEndian(out, 0, 2);
+}
+
+bool isOwnKingAttacked(const ChessBoard& board) {
+    for (int square = 0; square < 64; ++square) {
+        const ChessPiece* piece = board.getPiece(square & 7, square >> 3);
+        if (isKing(piece) && piece->getIsWhite() == board.isWhiteToMove()) {
+            return board.isSquareAttacked(square & 7, square >> 3, !board.isWhiteToMove());
+        }
+    }
+    return false;
+}
+
+// datagen <out> <games> <engine> [threads] [seed]: self-play from the start position after
+// eight random plies. Only quiet positions are kept (best move not a capture, king not
+// attacked, score not a mate), labelled with the game result once it is known.
+int generateTrainingData(const std::string& path, uint64_t games, const EngineConfig& engine, unsigned threads,
+                         uint64_t seed) {
+    static const int RANDOM_PLIES = 8;
+    static const int MAX_GAME_PLIES = 400;
+    static const int RESIGN_SCORE = 1500;
+    static const size_t CHUNK_SIZE = 1 << 16;
+    
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cout << "Cannot create " << path << ".\n";
+        return 1;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    std::string header = "COTD";
+    putLittleEndian(header, 1, 2);
+    putLittleEndian(header, TRAINING_RECORD_SIZE, 2);
+    std::fwrite(header.data(), 1, header.size(), file);
+    
+    // Workers hand over full chunks so the writer never sees partial games
+    BoundedQueue<std::string> chunks(threads * 4);
+    std::thread writer([&] {
+        std::string chunk;
+        while (chunks.pop(chunk)) {
+            std::fwrite(chunk.data(), 1, chunk.size(), file);
+        }
+    });
+    
+    std::atomic<uint64_t> nextGame(0);
+    std::atomic<uint64_t> positions(0);
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            EvalCache evalCache(256);
+            TranspositionTable tt(engine.hashMb);
+            SearchSignals signals;
+            ChessBoard board, start;
+            std::vector<Move> moves;
+            std::vector<uint64_t> history;
+            std::vector<std::pair<std::string, bool>> pending;     // record without result, white to move
+            std::string chunk, record;
+            
+            for (uint64_t game = nextGame++; game < games; game = nextGame++) {
+                std::mt19937_64 random(seed ^ (game * 0x9E3779B97F4A7C15ULL));
+                board = start;
+                tt.clear();
+                evalCache.clear();
+                pending.clear();
+                history.assign(1, board.getHash());
+                
+                bool kingTaken = false;
+                for (int ply = 0; ply < RANDOM_PLIES && !kingTaken; ++ply) {
+                    board.generateMoves(moves);
+                    if (moves.empty()) break;
+                    ChessPiece* captured = board.doMove(moves[random() % moves.size()]);
+                    kingTaken = isKing(captured);
+                    delete captured;
+                    history.push_back(board.getHash());
+                }
+                if (kingTaken) {
+                    continue;
+                }
+                
+                int whiteResult = 0;
+                for (int ply = RANDOM_PLIES; ply < MAX_GAME_PLIES; ++ply) {
+                    Search search(board, evalCache, tt, signals);
+                    SearchInfo info = search.run(engine.limits, [](const SearchInfo&) {});
+                    if (info.pv.empty()) {
+                        break;
+                    }
+                    int sign = board.isWhiteToMove() ? 1 : -1;
+                    if (std::abs(info.score) >= RESIGN_SCORE) {
+                        whiteResult = info.score > 0 ? sign : -sign;
+                        break;
+                    }
+                    const Move& best = info.pv[0];
+                    if (board.pieceAt(best.toY * 8 + best.toX) == 0 && !isOwnKingAttacked(board)) {
+                        record.clear();
+                        encodeTrainingRecord(board, info.score, 0, ply, record);
+                        pending.emplace_back(record, board.isWhiteToMove());
+                    }
+                    ChessPiece* captured = board.doMove(best);
+                    kingTaken = isKing(captured);
+                    delete captured;
+                    if (kingTaken) {
+                        whiteResult = sign;
+                        break;
+                    }
+                    history.push_back(board.getHash());
+                    if (std::count(history.begin(), history.end(), board.getHash()) >= 3) {
+                        break;
+                    }
+                }
+                
+                // The result byte sits at offset 26 of each record
+                for (auto& entry : pending) {
+                    entry.first[26] = static_cast<char>(entry.second ? whiteResult : -whiteResult);
+                    chunk += entry.first;
+                }
+                positions += pending.size();
+                if (chunk.size() >= CHUNK_SIZE) {
+                    chunks.push(std::move(chunk));
+                    chunk.clear();
+                }
+            }
+            if (!chunk.empty()) {
+                chunks.push(std::move(chunk));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    chunks.close();
+    writer.join();
+    std::fclose(file);
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double rate = seconds > 0 ? positions / seconds : 0.0;
+    char text[160];
+    std::snprintf(text, sizeof(text), "Games: %llu, positions: %llu, time: %.1f s, %.0f positions/s (%.0f per thread)",
+                  static_cast<unsigned long long>(games), static_cast<unsigned long long>(positions.load()), seconds,
+                  rate, rate / threads);
+    std::cout << text << "\n";
+    return 0;
+}
+
+// Server-side game state. A session keeps one byte per square (the loadSquares encoding) and
+// the packed moves so far; a shared scratch ChessBoard is only filled to validate a move.
+struct CompactGame {
+    enum Status : uint8_t { ONGOING, WHITE_WON, BLACK_WON };
+    
+    uint32_t id;
+    uint8_t squares[64];
+    bool whiteToMove;
+    uint8_t status;
+    std::vector<uint16_t> moves;        // Move::pack() of every ply
+    
+    void reset(const ChessBoard& board) {
+        for (int square = 0; square < 64; ++square) {
+            squares[square] = board.pieceAt(square);
+        }
+        whiteToMove = board.isWhiteToMove();
+        status = ONGOING;
+        moves.clear();
+    }
+    
+    void load(ChessBoard& board) const {
+        board.loadSquares(squares, whiteToMove);
+    }
+    
+    bool play(ChessBoard& scratch, const Move& move) {
+        if (status != ONGOING) {
+            return false;
+        }
+        load(scratch);
+        if (!scratch.isLegalMove(move)) {
+            return false;
+        }
+        uint8_t& from = squares[move.fromY * 8 + move.fromX];
+        uint8_t& to = squares[move.toY * 8 + move.toX];
+        if (to == 1 + 5 || to == 1 + 11) {
+            status = whiteToMove ? WHITE_WON : BLACK_WON;
+        }
+        to = from;
+        from = 0;
+        moves.push_back(move.pack());
+        whiteToMove = !whiteToMove;
+        return true;
+    }
+};
+
+// Game snapshots for checkpointing live games: "COGS" u16 version u16 reserved, then per game
+//   u32 id, u8 flags (bit 0 black to move, bits 1-2 status), u64 occupancy (bit y * 8 + x),
+//   4-bit piece codes for the occupied squares in square order, u16 plies, u16 Move::pack()
+//   per ply. A fresh game is 32 bytes; restoring needs no move replay.
+void encodeGameSnapshot(const CompactGame& game, std::string& out) {
+    putLittleEndian(out, game.id, 4);
+    out += static_cast<char>((game.whiteToMove ? 0 : 1) | (game.status << 1));
+    uint64_t occupancy = 0;
+    for (int square = 0; square < 64; ++square) {
+        if (game.squares[square] != 0) occupancy |= 1ULL << square;
+    }
+    putLittleEndian(out, occupancy, 8);
+    int count = 0;
+    char packed = 0;
+    for (int square = 0; square < 64; ++square) {
+        if (game.squares[square] == 0) continue;
+        packed |= static_cast<char>((game.squares[square] - 1) << (4 * (count & 1)));
+        if (++count % 2 == 0) {
+            out += packed;
+            packed = 0;
+        }
+    }
+    if (count % 2 != 0) out += packed;
+    putLittleEndian(out, game.moves.size(), 2);
+    for (uint16_t move : game.moves) {
+        putLittleEndian(out, move, 2);
+    }
+}
+
+// Reads one record at in and advances it; false on a truncated or corrupt record
+bool decodeGameSnapshot(const char*& in, const char* end, CompactGame& game) {
+    if (end - in < 13) {
+        return false;
+    }
+    game.id = static_cast<uint32_t>(getLittleEndian(in, 4));
+    uint8_t flags = static_cast<uint8_t>(in[4]);
+    uint64_t occupancy = getLittleEndian(in + 5, 8);
+    in += 13;
+    int count = __builtin_popcountll(occupancy);
+    if ((flags >> 1) > CompactGame::BLACK_WON || end - in < (count + 1) / 2 + 2) {
+        return false;
+    }
+    int index = 0;
+    for (int square = 0; square < 64; ++square) {
+        if ((occupancy >> square) & 1) {
+            int code = (static_cast<unsigned char>(in[index / 2]) >> (4 * (index & 1))) & 15;
+            if (code > 11) return false;
+            game.squares[square] = static_cast<uint8_t>(1 + code);
+            ++index;
+        } else {
+            game.squares[square] = 0;
+        }
+    }
+    in += (count + 1) / 2;
+    size_t plies = static_cast<size_t>(getLittleEndian(in, 2));
+    in += 2;
+    if (static_cast<size_t>(end - in) < plies * 2) {
+        return false;
+    }
+    game.moves.resize(plies);
+    for (size_t i = 0; i < plies; ++i) {
+        game.moves[i] = static_cast<uint16_t>(getLittleEndian(in + 2 * i, 2));
+    }
+    in += plies * 2;
+    game.whiteToMove = (flags & 1) == 0;
+    game.status = static_cast<uint8_t>(flags >> 1);
+    return true;
+}
+
+// Streams snapshots into "<path>.tmp" and renames it over path on commit, so a crash during a
+// checkpoint leaves the previous one intact
+class SnapshotWriter {
+private:
+    FILE* file;
+    std::string path;
+    std::string record;
+    size_t count;
+    
+public:
+    SnapshotWriter() : file(nullptr), count(0) {}
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+    
+    ~SnapshotWriter() {
+        if (file != nullptr) {
+            std::fclose(file);
+            std::remove((path + ".tmp").c_str());
+        }
+    }
+    
+    bool open(const std::string& target) {
+        path = target;
+        count = 0;
+        file = std::fopen((path + ".tmp").c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        std::string header = "COGS";
+        putLittleEndian(header, 1, 2);
+        putLittleEndian(header, 0, 2);
+        return std::fwrite(header.data(), 1, header.size(), file) == header.size();
+    }
+    
+    void add(const CompactGame& game) {
+        record.clear();
+        encodeGameSnapshot(game, record);
+        std::fwrite(record.data(), 1, record.size(), file);
+        ++count;
+    }
+    
+    bool commit() {
+        bool ok = std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok && std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    }
+    
+    size_t size() const { return count; }
+};
+
+// Calls onGame for every game in a snapshot file; false if it cannot be read in full
+template <typename Callback>
+bool restoreGameSnapshots(const std::string& path, Callback onGame) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < 8 || std::memcmp(file.begin(), "COGS", 4) != 0 ||
+        getLittleEndian(file.begin() + 4, 2) != 1) {
+        return false;
+    }
+    CompactGame game;
+    const char* in = file.begin() + 8;
+    while (in != file.end()) {
+        if (!decodeGameSnapshot(in, file.end(), game)) {
+            return false;
+        }
+        onGame(game);
+    }
+    return true;
+}
+
+struct ServerSession {
+    int fd;
+    CompactGame game;
+    std::string input;      // bytes after the last complete line
+    std::string output;     // replies the socket did not take yet
+};
+
+// Line protocol, one game per connection:
+//   new [fen]   ok                        move <uci>  ok [1-0|0-1] | illegal | gameover
+//   fen         <fen>                     moves       <legal moves>
+//   history     <moves played>            stats       session count and pool usage
+//   id          id <game id>              resume <id> ok | error unknown game
+//   checkpoint  ok <n> games              quit
+// Single-threaded epoll loop; sessions are indexed by file descriptor. With a snapshot file,
+// games are restored from it at startup (parked until a client resumes them) and written
+// back on "checkpoint" and on SIGINT/SIGTERM.
+class GameServer {
+private:
+    int listenFd;
+    int epollFd;
+    std::string unixPath;
+    std::vector<ServerSession*> sessions;
+    size_t sessionCount;
+    ObjectPool<ServerSession> sessionPool;
+    ChessBoard scratch;
+    ChessBoard startBoard;
+    std::vector<Move> moveList;
+    std::string snapshotPath;
+    std::map<uint32_t, CompactGame> parkedGames;    // restored and not yet resumed
+    uint32_t nextGameId;
+    
+    static volatile sig_atomic_t& stopRequested() {
+        static volatile sig_atomic_t requested = 0;
+        return requested;
+    }
+    
+    static void onStopSignal(int) {
+        stopRequested() = 1;
+    }
+    
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+    
+    void watch(int fd, uint32_t events, int operation) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, operation, fd, &event);
+    }
+    
+    void acceptClients() {
+        while (true) {
+            int fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                return;     // EAGAIN once the backlog is drained
+            }
+            if (!setNonBlocking(fd)) {
+                ::close(fd);
+                continue;
+            }
+            if (static_cast<size_t>(fd) >= sessions.size()) {
+                sessions.resize(fd + 1024, nullptr);
+            }
+            ServerSession* session = sessionPool.create();
+            session->fd = fd;
+            session->game.reset(startBoard);
+            session->game.id = nextGameId++;
+            sessions[fd] = session;
+            ++sessionCount;
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+    }
+    
+    void closeSession(ServerSession* session) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session->fd, nullptr);
+        ::close(session->fd);
+        sessions[session->fd] = nullptr;
+        --sessionCount;
+        sessionPool.destroy(session);
+    }
+    
+    // Returns false once the peer is gone
+    bool flush(ServerSession& session) {
+        while (!session.output.empty()) {
+            ssize_t written = ::send(session.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return false;
+            }
+            session.output.erase(0, static_cast<size_t>(written));
+        }
+        watch(session.fd, session.output.empty() ? EPOLLIN | EPOLLRDHUP : EPOLLIN | EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+        return true;
+    }
+    
+    // Returns false when the session asked to quit
+    bool handleLine(ServerSession& session, const std::string& line) {
+        TokenReader tokens(line);
+        std::string_view command = tokens.next();
+        std::string& out = session.output;
+        if (command == "move") {
+            Move move;
+            bool wasWhite = session.game.whiteToMove;
+            if (session.game.status != CompactGame::ONGOING) {
+                out += "gameover\n";
+            } else if (!Move::parse(tokens.next(), move) || !session.game.play(scratch, move)) {
+                out += "illegal\n";
+            } else if (session.game.status != CompactGame::ONGOING) {
+                out += wasWhite ? "ok 1-0\n" : "ok 0-1\n";
+            } else {
+                out += "ok\n";
+            }
+        } else if (command == "new") {
+            std::string fen(line.substr(line.find("new") + 3));
+            if (fen.find_first_not_of(' ') == std::string::npos) {
+                session.game.reset(startBoard);
+                out += "ok\n";
+            } else if (scratch.loadFen(fen)) {
+                session.game.reset(scratch);
+                out += "ok\n";
+            } else {
+                out += "error invalid position\n";
+            }
+        } else if (command == "fen") {
+            session.game.load(scratch);
+            out += scratch.toFen() + "\n";
+        } else if (command == "moves") {
+            session.game.load(scratch);
+            scratch.generateMoves(moveList);
+            for (size_t i = 0; i < moveList.size(); ++i) {
+                out += (i == 0 ? "" : " ") + moveList[i].toString();
+            }
+            out += "\n";
+        } else if (command == "history") {
+            for (size_t i = 0; i < session.game.moves.size(); ++i) {
+                out += (i == 0 ? "" : " ") + Move::unpack(session.game.moves[i]).toString();
+            }
+            out += "\n";
+        } else if (command == "id") {
+            out += "id " + std::to_string(session.game.id) + "\n";
+        } else if (command == "resume") {
+            auto parked = parkedGames.find(static_cast<uint32_t>(tokens.nextInt()));
+            if (parked == parkedGames.end()) {
+                out += "error unknown game\n";
+            } else {
+                session.game = std::move(parked->second);
+                parkedGames.erase(parked);
+                out += "ok\n";
+            }
+        } else if (command == "checkpoint") {
+            long saved = checkpoint();
+            out += saved < 0 ? "error checkpoint failed\n" : "ok " + std::to_string(saved) + " games\n";
+        } else if (command == "stats") {
+            out += "sessions " + std::to_string(sessionCount) + " | session pool " + sessionPool.stats().summary() +
+                   " | piece pool " + ChessPiece::poolSummary() + "\n";
+        } else if (command == "quit") {
+            return false;
+        } else if (!command.empty()) {
+            out += "error unknown command\n";
+        }
+        return true;
+    }
+    
+    void onReadable(ServerSession* session) {
+        char buffer[4096];
+        bool open = true;
+        while (open) {
+            ssize_t received = ::recv(session->fd, buffer, sizeof(buffer), 0);
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                open = false;
+            } else if (received < 0) {
+                break;
+            } else {
+                session->input.append(buffer, static_cast<size_t>(received));
+            }
+        }
+        
+        size_t start = 0;
+        for (size_t newline = session->input.find('\n'); newline != std::string::npos && open;
+             newline = session->input.find('\n', start)) {
+            open = handleLine(*session, session->input.substr(start, newline - start));
+            start = newline + 1;
+        }
+        session->input.erase(0, start);
+        // A client that never sends a newline cannot grow the buffer without bound
+        if (session->input.size() > 4096) {
+            open = false;
+        }
+        if (!flush(*session) || !open) {
+            closeSession(session);
+        }
+    }
+    
+public:
+    explicit GameServer(const std::string& snapshot = "")
+        : listenFd(-1), epollFd(-1), sessionCount(0), snapshotPath(snapshot), nextGameId(1) {}
+    GameServer(const GameServer&) = delete;
+    GameServer& operator=(const GameServer&) = delete;
+    
+    ~GameServer() {
+        for (ServerSession* session : sessions) {
+            if (session != nullptr) {
+                ::close(session->fd);
+                sessionPool.destroy(session);
+            }
+        }
+        if (epollFd >= 0) ::close(epollFd);
+        if (listenFd >= 0) ::close(listenFd);
+        if (!unixPath.empty()) ::unlink(unixPath.c_str());
+    }
+    
+    // A port number listens on 127.0.0.1, anything else is a Unix socket path
+    bool listen(const std::string& address) {
+        bool isPort = !address.empty() && address.find_first_not_of("0123456789") == std::string::npos;
+        listenFd = ::socket(isPort ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            return false;
+        }
+        int result;
+        if (isPort) {
+            int reuse = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(std::atoi(address.c_str())));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            result = ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        } else {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (address.size() >= sizeof(addr.sun_path)) {
+                return false;
+            }
+            std::strcpy(addr.sun_path, address.c_str());
+            ::unlink(address.c_str());
+            result = ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            if (result == 0) unixPath = address;
+        }
+        if (result != 0 || ::listen(listenFd, SOMAXCONN) != 0 || !setNonBlocking(listenFd)) {
+            return false;
+        }
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) {
+            return false;
+        }
+        watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+        return true;
+    }
+    
+    // Returns the number of games restored, or -1 if the snapshot exists but cannot be read
+    long restore() {
+        if (snapshotPath.empty() || access(snapshotPath.c_str(), F_OK) != 0) {
+            return 0;
+        }
+        bool ok = restoreGameSnapshots(snapshotPath, [this](const CompactGame& game) {
+            parkedGames[game.id] = game;
+            nextGameId = std::max(nextGameId, game.id + 1);
+        });
+        return ok ? static_cast<long>(parkedGames.size()) : -1;
+    }
+    
+    // Writes every connected and parked game; returns the count, or -1 on failure
+    long checkpoint() {
+        SnapshotWriter writer;
+        if (snapshotPath.empty() || !writer.open(snapshotPath)) {
+            return -1;
+        }
+        for (const ServerSession* session : sessions) {
+            if (session != nullptr) writer.add(session->game);
+        }
+        for (const auto& parked : parkedGames) {
+            writer.add(parked.second);
+        }
+        size_t count = writer.size();
+        return writer.commit() ? static_cast<long>(count) : -1;
+    }
+    
+    void run() {
+        struct sigaction action {};
+        action.sa_handler = onStopSignal;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        
+        epoll_event events[256];
+        while (!stopRequested()) {
+            int count = epoll_wait(epollFd, events, 256, -1);
+            if (count < 0 && errno != EINTR) {
+                return;
+            }
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptClients();
+                    continue;
+                }
+                ServerSession* session = static_cast<size_t>(fd) < sessions.size() ? sessions[fd] : nullptr;
+                if (session == nullptr) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    onReadable(session);
+                } else if ((events[i].events & EPOLLOUT) && !flush(*session)) {
+                    closeSession(session);
+                }
+            }
+        }
+    }
+};
+
+int runGameServer(const std::string& address, const std::string& snapshotPath) {
+    GameServer server(snapshotPath);
+    long restored = server.restore();
+    if (restored < 0) {
+        std::cout << "Cannot read snapshot " << snapshotPath << ".\n";
+        return 1;
+    }
+    if (!server.listen(address)) {
+        std::cout << "Cannot listen on " << address << ".\n";
+        return 1;
+    }
+    std::cout << "Listening on " << address << " (" << sizeof(ServerSession) << " bytes per session, "
+              << restored << " games restored)\n";
+    std::cout.flush();
+    server.run();
+    if (!snapshotPath.empty()) {
+        long saved = server.checkpoint();
+        std::cout << (saved < 0 ? "Cannot write snapshot " + snapshotPath + ".\n"
+                                : "Saved " + std::to_string(saved) + " games to " + snapshotPath + ".\n");
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "uci") {
+        UciEngine engine;
+        engine.run(std::cin);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "pgn") {
+        return replayPgnFile(argv[2]);
+    }
+    if (argc > 3 && std::string(argv[1]) == "pgn2bin") {
+        return convertPgnToArchive(argv[2], argv[3]);
+    }
+    if (argc > 2 && std::string(argv[1]) == "binreplay") {
+        return replayArchive(argv[2]);
+    }
+    if (argc > 4 && std::string(argv[1]) == "posindex" && std::string(argv[2]) == "build") {
+        // posindex build <archive> <index> [run MB]
+        size_t runMb = argc > 5 ? static_cast<size_t>(std::max(1, std::atoi(argv[5]))) : 512;
+        return buildPositionIndex(argv[3], argv[4], runMb);
+    }
+    if (argc > 4 && std::string(argv[1]) == "posindex" && std::string(argv[2]) == "find") {
+        return queryPositionIndex(argv[3], argv[4]);
+    }
+    if (argc > 4 && std::string(argv[1]) == "openings") {
+        // openings build <out> <inputs...> | openings merge <out> <trees...> | openings show <tree> <fen>
+        std::string action = argv[2];
+        std::vector<std::string> inputs(argv + 4, argv + argc);
+        if (action == "build") return buildOpeningTree(inputs, argv[3], defaultThreadCount(), 30);
+        if (action == "merge") return mergeOpeningTrees(inputs, argv[3]);
+        if (action == "show") return queryOpeningTree(argv[3], argv[4]);
+    }
+    if (argc > 4 && std::string(argv[1]) == "book") {
+        // book <keys> <book.bin> <fen>
+        return showBookMoves(argv[2], argv[3], argv[4]);
+    }
+    if (argc > 3 && std::string(argv[1]) == "tbgen") {
+        return generateTablebases(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+    }
+    if (argc > 3 && std::string(argv[1]) == "tbprobe") {
+        return probeTablebases(argv[2], argv[3]);
+    }
+    if (argc > 2 && std::string(argv[1]) == "batch") {
+        // batch <depth> [file|-] [threads]
+        unsigned threads = argc > 4 ? static_cast<unsigned>(std::max(1, std::atoi(argv[4]))) : defaultThreadCount();
+        return runBatchAnalysis(std::max(1, std::atoi(argv[2])), argc > 3 ? argv[3] : "-", threads);
+    }
+    if (argc > 4 && std::string(argv[1]) == "epdtest") {
+        // epdtest <file> <time|nodes> <limit> [threads]
+        unsigned threads = argc > 5 ? static_cast<unsigned>(std::max(1, std::atoi(argv[5]))) : defaultThreadCount();
+        return runEpdSuite(argv[2], std::string(argv[3]) == "nodes", std::max<int64_t>(1, std::atoll(argv[4])), threads);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        // bench [depth]
+        return runBench(argc > 2 ? std::max(1, std::atoi(argv[2])) : 5);
+    }
+    if (argc > 1 && std::string(argv[1]) == "render") {
+        // render [file|-] [text|unicode]
+        RenderStyle style = argc > 3 && std::string(argv[3]) == "unicode" ? RenderStyle::Unicode : RenderStyle::Text;
+        return renderPositions(argc > 2 ? argv[2] : "-", style);
+    }
+    if (argc > 1 && std::string(argv[1]) == "selftest") {
+        return runSelfTest();
+    }
+    if (argc > 1 && std::string(argv[1]) == "microbench") {
+        return runMicroBenchmarks(argc > 2 ? argv[2] : "text");
+    }
+    if (argc > 4 && std::string(argv[1]) == "match") {
+        // match <openings> <first> <second> [max games] [threads] [elo0] [elo1]
+        EngineConfig first, second;
+        if (!first.parse(argv[3], "first") || !second.parse(argv[4], "second") || first.command.empty() ||
+            second.command.empty()) {
+            std::cout << "Engine options are cmd=, name=, tc=, depth=, nodes=, movetime=, hash= and option.<name>=, "
+                         "with cmd= and at least one limit.\n";
+            return 1;
+        }
+        uint64_t maxGames = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 20000;
+        unsigned threads = argc > 6 ? static_cast<unsigned>(std::max(1, std::atoi(argv[6]))) : defaultThreadCount();
+        return runMatch(argv[2], first, second, maxGames, threads, argc > 7 ? std::atof(argv[7]) : 0.0,
+                        argc > 8 ? std::atof(argv[8]) : 10.0);
+    }
+    if (argc > 4 && std::string(argv[1]) == "datagen") {
+        // datagen <out> <games> <engine> [threads] [seed]
+        EngineConfig engine;
+        if (!engine.parse(argv[4], "datagen") || engine.baseTime > 0) {
+            std::cout << "Engine options are depth=, nodes=, movetime= and hash=, with at least one limit.\n";
+            return 1;
+        }
+        unsigned threads = argc > 5 ? static_cast<unsigned>(std::max(1, std::atoi(argv[5]))) : defaultThreadCount();
+        return generateTrainingData(argv[2], std::strtoull(argv[3], nullptr, 10), engine, threads,
+                                    argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 1);
+    }
+    if (argc > 2 && std::string(argv[1]) == "server") {
+        // server <port|socket path> [snapshot file]
+        return runGameServer(argv[2], argc > 3 ? argv[3] : "");
+    }
+    if (argc > 2 && std::string(argv[1]) == "pgnscan") {
+        // pgnscan <file> [threads] [none|hash|fen]
+        unsigned threads = argc > 3 ? static_cast<unsigned>(std::max(1, std::atoi(argv[3]))) : defaultThreadCount();
+        std::string format = argc > 4 ? argv[4] : "hash";
+        return replayPgnFileParallel(argv[2], threads,
+                                     format == "fen" ? PgnOutput::Fen : format == "none" ? PgnOutput::None : PgnOutput::Hash);
+    }
+    
+    // A GUI launches the engine without arguments on a pipe and speaks first, so when stdin
+    // is not a terminal nothing is printed until the first line shows whether it is UCI
+    std::string input, from, to;
+    bool haveInput = false;
+    if (!isatty(STDIN_FILENO)) {
+        if (!std::getline(std::cin, input)) {
+            return 0;
+        }
+        haveInput = true;
+        if (TokenReader(input).next() == "uci") {
+            UciEngine engine;
+            if (engine.handleCommand(input)) {
+                engine.run(std::cin);
+            }
+            return 0;
+        }
+    }
+
+    std::cout << "========== C++ Chess Game ==========\n";
+    std::cout << "Enter moves in algebraic notation (e.g., e2 e4)\n";
+    std::cout << "Enter 'quit' to exit\n";
+    
+    ChessBoard board;
+    
+    while (!board.isGameOver()) {
+        board.display();
+        
+        std::cout << "Enter move: ";
+        if (!haveInput && !std::getline(std::cin, input)) {
+            break;
+        }
+        haveInput = false;
         
         if (input == "quit") {
             break;
         }
         
+        // A GUI talking UCI takes over the session
+        if (input == "uci") {
+            UciEngine engine;
+            if (engine.handleCommand(input)) {
+                engine.run(std::cin);
+            }
+            return 0;
+        }
+        
         // Parse input - expecting format like "e2 e4"
         std::istringstream iss(input);
         if (!(iss >> from >> to)) {